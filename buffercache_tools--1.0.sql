@@ -33,6 +33,85 @@ RETURNS SETOF RECORD
 AS 'MODULE_PATHNAME', 'pg_show_relation_buffers'
 LANGUAGE C STRICT;
 
+--
+-- pg_show_buffers()
+--
+CREATE FUNCTION pg_show_buffers(
+    IN filter_dboid Oid DEFAULT NULL,
+    IN filter_spcoid Oid DEFAULT NULL,
+    IN filter_relnumber Oid DEFAULT NULL,
+    IN filter_fork text DEFAULT NULL,
+    IN filter_dirty bool DEFAULT NULL,
+    IN min_usagecount smallint DEFAULT NULL,
+    OUT buffernum integer,
+    OUT blocknum bigint,
+    OUT fork text,
+    OUT relnumber Oid,
+    OUT dboid Oid,
+    OUT spcoid Oid,
+    OUT dirty bool,
+    OUT usagecount smallint,
+    OUT pinning integer)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_show_buffers'
+LANGUAGE C CALLED ON NULL INPUT;
+
+--
+-- pg_show_buffer_page()
+--
+CREATE FUNCTION pg_show_buffer_page(IN buffer integer,
+    OUT lsn pg_lsn,
+    OUT checksum integer,
+    OUT flags integer,
+    OUT all_visible bool,
+    OUT has_free_lines bool,
+    OUT free_space integer,
+    OUT line_pointers integer)
+RETURNS RECORD
+AS 'MODULE_PATHNAME', 'pg_show_buffer_page'
+LANGUAGE C STRICT;
+
+--
+-- pg_relation_cached_pages_stats()
+--
+CREATE FUNCTION pg_relation_cached_pages_stats(
+    IN relname text,
+    IN fork text DEFAULT 'main',
+    IN lsn_threshold pg_lsn DEFAULT NULL,
+    OUT cached_pages bigint,
+    OUT dirty_pages bigint,
+    OUT new_pages bigint,
+    OUT all_visible_pages bigint,
+    OUT pages_with_free_lines bigint,
+    OUT free_space bigint,
+    OUT line_pointers bigint,
+    OUT min_lsn pg_lsn,
+    OUT max_lsn pg_lsn,
+    OUT pages_lsn_older bigint)
+RETURNS RECORD
+AS 'MODULE_PATHNAME', 'pg_relation_cached_pages_stats'
+LANGUAGE C CALLED ON NULL INPUT;
+
+--
+-- pg_verify_cached_pages()
+--
+CREATE FUNCTION pg_verify_cached_pages(
+    IN relname text DEFAULT NULL,
+    IN dboid oid DEFAULT NULL,
+    IN spcoid oid DEFAULT NULL,
+    IN first_buffer integer DEFAULT NULL,
+    IN last_buffer integer DEFAULT NULL,
+    OUT buffernum integer,
+    OUT relfilenode oid,
+    OUT reldatabase oid,
+    OUT reltablespace oid,
+    OUT fork text,
+    OUT blocknum bigint,
+    OUT problem text)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_verify_cached_pages'
+LANGUAGE C CALLED ON NULL INPUT;
+
 --
 -- pg_read_page_into_buffer()
 --
@@ -44,6 +123,27 @@ RETURNS integer
 AS 'MODULE_PATHNAME', 'pg_read_page_into_buffer'
 LANGUAGE C STRICT;
 
+--
+-- pg_read_blocks_into_buffer()
+--
+CREATE FUNCTION pg_read_blocks_into_buffer(
+    IN rel regclass,
+    IN fork text,
+    IN blocknums bigint[])
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_read_blocks_into_buffer'
+LANGUAGE C STRICT;
+
+--
+-- pg_prewarm_index_upper_levels()
+--
+CREATE FUNCTION pg_prewarm_index_upper_levels(
+    IN rel regclass,
+    IN levels integer DEFAULT 2)
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_prewarm_index_upper_levels'
+LANGUAGE C STRICT;
+
 --
 -- pg_change_buffer()
 --
@@ -344,4 +444,316 @@ AS $$
             WHEN 'init' THEN 3 
         END
     );
-$$ LANGUAGE SQL;
\ No newline at end of file
+$$ LANGUAGE SQL;
+
+--
+-- pg_buffercache_tools_progress
+--
+CREATE FUNCTION pg_buffercache_tools_progress(
+    OUT pid integer,
+    OUT scope text,
+    OUT mode text,
+    OUT buffers_total bigint,
+    OUT buffers_scanned bigint,
+    OUT buffers_processed bigint,
+    OUT bytes_written bigint,
+    OUT started timestamptz)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_tools_progress'
+LANGUAGE C STRICT;
+
+CREATE VIEW pg_buffercache_tools_progress AS
+    SELECT * FROM pg_buffercache_tools_progress();
+
+--
+-- Background flush worker schedule
+--
+CREATE TABLE buffercache_tools_flush_schedule (
+    id serial PRIMARY KEY,
+    relid regclass,
+    dboid oid,
+    flush_interval interval NOT NULL DEFAULT '1 min',
+    max_dirty_fraction float8
+        CHECK (max_dirty_fraction BETWEEN 0 AND 1),
+    max_flush_rate integer NOT NULL DEFAULT 0
+        CHECK (max_flush_rate >= 0),
+    enabled bool NOT NULL DEFAULT true,
+    last_run timestamptz,
+    CHECK ((relid IS NULL) <> (dboid IS NULL))
+);
+
+CREATE TABLE buffercache_tools_flush_history (
+    schedule_id integer NOT NULL
+        REFERENCES buffercache_tools_flush_schedule (id) ON DELETE CASCADE,
+    started timestamptz NOT NULL,
+    finished timestamptz NOT NULL,
+    reason text NOT NULL,
+    dirty_fraction float8,
+    buffers_scanned bigint NOT NULL,
+    buffers_written bigint NOT NULL,
+    bytes_written bigint NOT NULL
+);
+
+SELECT pg_catalog.pg_extension_config_dump('buffercache_tools_flush_schedule', '');
+SELECT pg_catalog.pg_extension_config_dump('buffercache_tools_flush_schedule_id_seq', '');
+SELECT pg_catalog.pg_extension_config_dump('buffercache_tools_flush_history', '');
+
+--
+-- Buffer residency snapshots
+--
+CREATE FUNCTION pg_buffer_residency_snapshot()
+RETURNS bytea
+AS 'MODULE_PATHNAME', 'pg_buffer_residency_snapshot'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffer_residency_diff(
+    IN before bytea,
+    IN after bytea,
+    OUT relfilenode oid,
+    OUT reldatabase oid,
+    OUT reltablespace oid,
+    OUT pages_added bigint,
+    OUT pages_evicted bigint,
+    OUT pages_retained bigint,
+    OUT usagecount_drift bigint)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffer_residency_diff'
+LANGUAGE C STRICT;
+
+--
+-- Hit ratio estimation
+--
+CREATE FUNCTION pg_buffer_mrc_sample()
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_buffer_mrc_sample'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffer_mrc_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_buffer_mrc_reset'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffer_mrc(
+    OUT datid oid,
+    OUT cache_size bigint,
+    OUT hit_ratio float8,
+    OUT references_sampled bigint)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffer_mrc'
+LANGUAGE C STRICT;
+
+--
+-- Hottest blocks
+--
+CREATE FUNCTION pg_buffer_hot_blocks_sample()
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_buffer_hot_blocks_sample'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffer_hot_blocks_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_buffer_hot_blocks_reset'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffer_hot_blocks(
+    IN nblocks integer DEFAULT 100,
+    OUT relfilenode oid,
+    OUT reldatabase oid,
+    OUT reltablespace oid,
+    OUT fork text,
+    OUT blocknum bigint,
+    OUT hotness bigint,
+    OUT max_error bigint)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffer_hot_blocks'
+LANGUAGE C STRICT;
+
+--
+-- Background worker keep-warm list
+--
+CREATE TABLE buffercache_tools_keep_warm (
+    id serial PRIMARY KEY,
+    relid regclass NOT NULL,
+    fork text NOT NULL DEFAULT 'main'
+        CHECK (fork IN ('main', 'fsm', 'vm', 'init')),
+    first_block bigint NOT NULL DEFAULT 0
+        CHECK (first_block >= 0),
+    last_block bigint
+        CHECK (last_block >= first_block),
+    min_usagecount integer
+        CHECK (min_usagecount BETWEEN 0 AND 5),
+    max_read_rate integer NOT NULL DEFAULT 0
+        CHECK (max_read_rate >= 0),
+    enabled bool NOT NULL DEFAULT true,
+    last_check timestamptz,
+    blocks_restored bigint NOT NULL DEFAULT 0
+);
+
+SELECT pg_catalog.pg_extension_config_dump('buffercache_tools_keep_warm', '');
+SELECT pg_catalog.pg_extension_config_dump('buffercache_tools_keep_warm_id_seq', '');
+
+--
+-- pg_flush_buffers_older_than()
+--
+CREATE FUNCTION pg_flush_buffers_older_than(
+    IN lsn pg_lsn,
+    IN relname text DEFAULT NULL,
+    IN fork text DEFAULT NULL,
+    IN dboid oid DEFAULT NULL,
+    IN spcoid oid DEFAULT NULL)
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_flush_buffers_older_than'
+LANGUAGE C CALLED ON NULL INPUT;
+
+--
+-- pg_buffercache_tools_stats
+--
+CREATE FUNCTION pg_buffercache_tools_stats(
+    OUT scope text,
+    OUT mode text,
+    OUT calls bigint,
+    OUT buffers_processed bigint,
+    OUT bytes_written bigint,
+    OUT total_time float8,
+    OUT lock_waits bigint,
+    OUT lock_wait_time float8,
+    OUT duration_hist bigint[],
+    OUT lock_wait_hist bigint[],
+    OUT stats_reset timestamptz)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_tools_stats'
+LANGUAGE C STRICT;
+
+CREATE VIEW pg_buffercache_tools_stats AS
+    SELECT * FROM pg_buffercache_tools_stats();
+
+CREATE FUNCTION pg_buffercache_tools_stats_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'pg_buffercache_tools_stats_reset'
+LANGUAGE C STRICT;
+
+--
+-- pg_extend_relation_buffers()
+--
+CREATE FUNCTION pg_extend_relation_buffers(
+    IN rel regclass,
+    IN fork text,
+    IN nblocks bigint)
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_extend_relation_buffers'
+LANGUAGE C STRICT;
+
+--
+-- Residency bitmaps of relation forks
+--
+CREATE FUNCTION pg_relation_residency_bitmap(
+    IN rel regclass,
+    IN fork text DEFAULT 'main',
+    IN compress bool DEFAULT false)
+RETURNS bytea
+AS 'MODULE_PATHNAME', 'pg_relation_residency_bitmap'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_residency_bitmap_count(IN bitmap bytea)
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_residency_bitmap_count'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION pg_residency_bitmap_and(IN a bytea, IN b bytea)
+RETURNS bytea
+AS 'MODULE_PATHNAME', 'pg_residency_bitmap_and'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION pg_residency_bitmap_diff(IN a bytea, IN b bytea)
+RETURNS bytea
+AS 'MODULE_PATHNAME', 'pg_residency_bitmap_diff'
+LANGUAGE C STRICT IMMUTABLE;
+
+--
+-- Jobs running buffer sweeps in background workers
+--
+CREATE FUNCTION pg_buffercache_tools_submit(
+    IN mode text,
+    IN scope text,
+    IN target oid DEFAULT NULL,
+    IN fork text DEFAULT NULL,
+    IN arg bigint DEFAULT NULL)
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_buffercache_tools_submit'
+LANGUAGE C CALLED ON NULL INPUT;
+
+CREATE FUNCTION pg_buffercache_tools_cancel(IN job_id bigint)
+RETURNS bool
+AS 'MODULE_PATHNAME', 'pg_buffercache_tools_cancel'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffercache_tools_jobs(
+    OUT job_id bigint,
+    OUT mode text,
+    OUT scope text,
+    OUT target oid,
+    OUT status text,
+    OUT pid integer,
+    OUT submitted timestamptz,
+    OUT started timestamptz,
+    OUT finished timestamptz,
+    OUT buffers_scanned bigint,
+    OUT buffers_processed bigint,
+    OUT bytes_written bigint,
+    OUT error text)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_tools_jobs'
+LANGUAGE C STRICT;
+
+CREATE VIEW pg_buffercache_tools_jobs AS
+    SELECT * FROM pg_buffercache_tools_jobs();
+
+--
+-- pg_remap_relation_buffers()
+--
+CREATE FUNCTION pg_remap_relation_buffers(
+    IN rel regclass,
+    IN old_relnumber oid,
+    IN old_spcoid oid DEFAULT NULL,
+    IN old_dboid oid DEFAULT NULL,
+    OUT remapped bigint,
+    OUT collisions bigint,
+    OUT pinned bigint,
+    OUT past_end bigint)
+RETURNS RECORD
+AS 'MODULE_PATHNAME', 'pg_remap_relation_buffers'
+LANGUAGE C CALLED ON NULL INPUT;
+
+--
+-- pg_buffer_mapping_partitions()
+--
+CREATE FUNCTION pg_buffer_mapping_partitions(
+    IN top_relations integer DEFAULT 5,
+    IN sample_time_ms integer DEFAULT 0,
+    OUT partition integer,
+    OUT buffers bigint,
+    OUT top_relations_buffers bigint,
+    OUT wait_samples bigint,
+    OUT wait_ratio float8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffer_mapping_partitions'
+LANGUAGE C STRICT;
+
+--
+-- pg_buffer_strategy()
+--
+CREATE FUNCTION pg_buffer_strategy(
+    OUT next_victim_buffer integer,
+    OUT complete_passes bigint,
+    OUT buffers_alloc bigint,
+    OUT freelist_buffers bigint,
+    OUT sweep_rate float8,
+    OUT alloc_rate float8,
+    OUT lap_time float8,
+    OUT usagecount_hist bigint[],
+    OUT unused_buffers bigint,
+    OUT pinned_buffers bigint,
+    OUT dirty_buffers bigint)
+RETURNS RECORD
+AS 'MODULE_PATHNAME', 'pg_buffer_strategy'
+LANGUAGE C STRICT;
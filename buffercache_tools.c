@@ -10,8 +10,14 @@
 
 #include "buffercache_tools_internals.h"
 
+#include "miscadmin.h"
+#include "utils/guc.h"
+#include "utils/pg_lsn.h"
+
 PG_MODULE_MAGIC;
 
+void _PG_init(void);
+
 PG_FUNCTION_INFO_V1(pg_change_buffer);
 PG_FUNCTION_INFO_V1(pg_change_relation_fork_buffers);
 PG_FUNCTION_INFO_V1(pg_change_relation_buffers);
@@ -22,7 +28,42 @@ PG_FUNCTION_INFO_V1(pg_change_buffer_by_page);
 
 PG_FUNCTION_INFO_V1(pg_show_buffer);
 PG_FUNCTION_INFO_V1(pg_show_relation_buffers);
+PG_FUNCTION_INFO_V1(pg_show_buffers);
+PG_FUNCTION_INFO_V1(pg_show_buffer_page);
+PG_FUNCTION_INFO_V1(pg_buffer_strategy);
+PG_FUNCTION_INFO_V1(pg_relation_cached_pages_stats);
+PG_FUNCTION_INFO_V1(pg_verify_cached_pages);
 PG_FUNCTION_INFO_V1(pg_read_page_into_buffer);
+PG_FUNCTION_INFO_V1(pg_read_blocks_into_buffer);
+PG_FUNCTION_INFO_V1(pg_prewarm_index_upper_levels);
+PG_FUNCTION_INFO_V1(pg_extend_relation_buffers);
+PG_FUNCTION_INFO_V1(pg_remap_relation_buffers);
+
+PG_FUNCTION_INFO_V1(pg_flush_buffers_older_than);
+
+PG_FUNCTION_INFO_V1(pg_buffer_residency_snapshot);
+PG_FUNCTION_INFO_V1(pg_buffer_residency_diff);
+PG_FUNCTION_INFO_V1(pg_buffer_mapping_partitions);
+PG_FUNCTION_INFO_V1(pg_relation_residency_bitmap);
+PG_FUNCTION_INFO_V1(pg_residency_bitmap_count);
+PG_FUNCTION_INFO_V1(pg_residency_bitmap_and);
+PG_FUNCTION_INFO_V1(pg_residency_bitmap_diff);
+
+PG_FUNCTION_INFO_V1(pg_buffer_mrc_sample);
+PG_FUNCTION_INFO_V1(pg_buffer_mrc_reset);
+PG_FUNCTION_INFO_V1(pg_buffer_mrc);
+
+PG_FUNCTION_INFO_V1(pg_buffer_hot_blocks_sample);
+PG_FUNCTION_INFO_V1(pg_buffer_hot_blocks_reset);
+PG_FUNCTION_INFO_V1(pg_buffer_hot_blocks);
+
+PG_FUNCTION_INFO_V1(pg_buffercache_tools_progress);
+PG_FUNCTION_INFO_V1(pg_buffercache_tools_stats);
+PG_FUNCTION_INFO_V1(pg_buffercache_tools_stats_reset);
+
+PG_FUNCTION_INFO_V1(pg_buffercache_tools_submit);
+PG_FUNCTION_INFO_V1(pg_buffercache_tools_cancel);
+PG_FUNCTION_INFO_V1(pg_buffercache_tools_jobs);
 
 /*
  * Number of arguments of pg_change_* functions
@@ -36,6 +77,109 @@ PG_FUNCTION_INFO_V1(pg_read_page_into_buffer);
 #define PG_CHANGE_ALL_VALID_BUFFERS_NUM_MAIN_ARGS		1	
 #define PG_CHANGE_BUFFER_BY_PAGE_MAIN_ARGS  			4	
 
+/*-------------------------------------------------------------------------
+ * 								module initialization
+ *-------------------------------------------------------------------------
+ */
+void
+_PG_init(void)
+{
+	RegisterXactCallback(bct_sweep_xact_callback, NULL);
+	RegisterSubXactCallback(bct_sweep_subxact_callback, NULL);
+
+	DefineCustomIntVariable("buffercache_tools.max_flush_rate",
+							"Maximum number of buffers flushed per second by flush modes.",
+							"Zero disables throttling.",
+							&bct_max_flush_rate,
+							0,
+							0, INT_MAX,
+							PGC_USERSET,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomStringVariable("buffercache_tools.worker_database",
+							   "Database the background flush worker connects to.",
+							   "The worker is not started if it is empty.",
+							   &bct_worker_database,
+							   "",
+							   PGC_POSTMASTER,
+							   0,
+							   NULL, NULL, NULL);
+
+	DefineCustomIntVariable("buffercache_tools.worker_naptime",
+							"Time between background flush worker rounds.",
+							NULL,
+							&bct_worker_naptime,
+							1000,
+							10, INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+
+	DefineCustomRealVariable("buffercache_tools.mrc_sample_rate",
+							 "Fraction of page tags tracked by the hit ratio estimator.",
+							 NULL,
+							 &bct_mrc_sample_rate,
+							 0.01,
+							 0.0001, 1.0,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("buffercache_tools.mrc_max_tracked",
+							"Maximum number of page tags tracked by the hit ratio estimator.",
+							"Zero disables the estimator.",
+							&bct_mrc_max_tracked,
+							0,
+							0, INT_MAX / 4,
+							PGC_POSTMASTER,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("buffercache_tools.mrc_sample_interval",
+							"Time between buffer cache samples taken by the background worker.",
+							"Zero disables sampling by the worker.",
+							&bct_mrc_sample_interval,
+							0,
+							0, INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("buffercache_tools.hot_blocks_max_tracked",
+							"Number of counters of the hottest blocks sketch.",
+							"Zero disables the sketch.",
+							&bct_hot_blocks_max_tracked,
+							0,
+							0, INT_MAX / 4,
+							PGC_POSTMASTER,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("buffercache_tools.hot_blocks_sample_interval",
+							"Time between hottest blocks samples taken by the background worker.",
+							"Zero disables sampling by the worker.",
+							&bct_hot_blocks_sample_interval,
+							0,
+							0, INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+
+#if (PG_VERSION_NUM >= 150000)
+	MarkGUCPrefixReserved("buffercache_tools");
+#else
+	EmitWarningsOnPlaceholders("buffercache_tools");
+#endif
+
+	/* Shared memory is available only via shared_preload_libraries */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	bct_shmem_init();
+	bct_worker_register();
+}
+
 /*-------------------------------------------------------------------------
  * 								extension functions	 
  *-------------------------------------------------------------------------
@@ -68,6 +212,89 @@ pg_show_relation_buffers(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(true);
 }
 
+/*
+ * Show buffers matching optional filters without materializing the result
+ */
+Datum
+pg_show_buffers(PG_FUNCTION_ARGS)
+{
+	return pg_show_buffers_internals(fcinfo);
+}
+
+/*
+ * Show page header of a cached page
+ */
+Datum
+pg_show_buffer_page(PG_FUNCTION_ARGS)
+{
+	Buffer buffer = (Buffer) PG_GETARG_INT32(0);
+
+	superuser_check();
+
+	return pg_show_buffer_page_internals(fcinfo, buffer);
+}
+
+/*
+ * Clock sweep and freelist state of the buffer replacement strategy
+ */
+Datum
+pg_buffer_strategy(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	return pg_buffer_strategy_internals(fcinfo);
+}
+
+/*
+ * Aggregate page headers of the cached pages of a relation fork
+ */
+Datum
+pg_relation_cached_pages_stats(PG_FUNCTION_ARGS)
+{
+	text		*relName;
+	text		*forkName;
+	XLogRecPtr	lsnThreshold = InvalidXLogRecPtr;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	relName = PG_GETARG_TEXT_PP(0);
+	forkName = PG_GETARG_TEXT_PP(1);
+	if (!PG_ARGISNULL(2))
+		lsnThreshold = PG_GETARG_LSN(2);
+
+	superuser_check();
+
+	return pg_relation_cached_pages_stats_internals(fcinfo, relName, forkName, 
+													lsnThreshold, !PG_ARGISNULL(2));
+}
+
+/*
+ * Check the header of clean cached pages, and that new ones are all zeros,
+ * without reading them from disk
+ */
+Datum
+pg_verify_cached_pages(PG_FUNCTION_ARGS)
+{
+	text	*relName = PG_ARGISNULL(0) ? NULL : PG_GETARG_TEXT_PP(0);
+	Oid		dbOid = PG_ARGISNULL(1) ? InvalidOid : PG_GETARG_OID(1);
+	Oid		spcOid = PG_ARGISNULL(2) ? InvalidOid : PG_GETARG_OID(2);
+	int32	firstBuffer = PG_ARGISNULL(3) ? 1 : PG_GETARG_INT32(3);
+	int32	lastBuffer = PG_ARGISNULL(4) ? NBuffers : PG_GETARG_INT32(4);
+
+	superuser_check();
+
+	if (!PG_ARGISNULL(1) && database_is_invalid_oid(dbOid))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("invalid database oid")));
+
+	pg_verify_cached_pages_internals(fcinfo, relName, dbOid, spcOid, 
+									 firstBuffer, lastBuffer);
+
+	return (Datum) 0;
+}
+
 /*
  * Read a specific page of a specific relation into the buffer cache
  */
@@ -83,6 +310,67 @@ pg_read_page_into_buffer(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32((int32) buffer);
 }
 
+/*
+ * Read a list of blocks of a specific relation into the buffer cache
+ */
+Datum
+pg_read_blocks_into_buffer(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	text		*forkName = PG_GETARG_TEXT_PP(1);
+	ArrayType	*blockNums = PG_GETARG_ARRAYTYPE_P(2);
+
+	PG_RETURN_INT64(pg_read_blocks_into_buffer_internals(relid, forkName, blockNums));
+}
+
+/*
+ * Read the metapage and the upper levels of a btree index into the buffer cache
+ */
+Datum
+pg_prewarm_index_upper_levels(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	int32		levels = PG_GETARG_INT32(1);
+
+	PG_RETURN_INT64(pg_prewarm_index_upper_levels_internals(relid, levels));
+}
+
+/*
+ * Extend a relation fork by zero-filled pages kept in the buffer cache
+ */
+Datum
+pg_extend_relation_buffers(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	text		*forkName = PG_GETARG_TEXT_PP(1);
+	int64		nblocks = PG_GETARG_INT64(2);
+
+	PG_RETURN_INT64(pg_extend_relation_buffers_internals(relid, forkName, nblocks));
+}
+
+/*
+ * Move the cached pages of an old relation file to the current one
+ */
+Datum
+pg_remap_relation_buffers(PG_FUNCTION_ARGS)
+{
+	Oid			relid;
+	Oid			oldRelNumber;
+	Oid			oldSpcOid = PG_ARGISNULL(2) ? InvalidOid : PG_GETARG_OID(2);
+	Oid			oldDbOid = PG_ARGISNULL(3) ? InvalidOid : PG_GETARG_OID(3);
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	relid = PG_GETARG_OID(0);
+	oldRelNumber = PG_GETARG_OID(1);
+
+	superuser_check();
+
+	return pg_remap_relation_buffers_internals(fcinfo, relid, oldRelNumber, 
+											   oldSpcOid, oldDbOid);
+}
+
 Datum
 pg_change_buffer(PG_FUNCTION_ARGS)
 {
@@ -232,4 +520,291 @@ pg_change_buffer_by_page(PG_FUNCTION_ARGS)
 	change_buffer_by_page_handler(buf_proc_func, relName, forkName, blockNum, bpf_args);
 
 	PG_RETURN_BOOL(true);
-}
\ No newline at end of file
+}
+/*
+ * Show progress of buffer sweeps running in all backends
+ */
+Datum
+pg_buffercache_tools_progress(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	pg_buffercache_tools_progress_internals(fcinfo);
+
+	return (Datum) 0;
+}
+
+/*
+ * Cumulative statistics of buffer sweeps by scope and mode
+ */
+Datum
+pg_buffercache_tools_stats(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	pg_buffercache_tools_stats_internals(fcinfo);
+
+	return (Datum) 0;
+}
+
+/*
+ * Reset cumulative statistics of buffer sweeps
+ */
+Datum
+pg_buffercache_tools_stats_reset(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	bct_stats_reset();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Capture contents of the buffer cache in a compact sorted format
+ */
+Datum
+pg_buffer_residency_snapshot(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	PG_RETURN_BYTEA_P(pg_buffer_residency_snapshot_internals());
+}
+
+/*
+ * Compare two buffer residency snapshots per relation
+ */
+Datum
+pg_buffer_residency_diff(PG_FUNCTION_ARGS)
+{
+	bytea *before = PG_GETARG_BYTEA_PP(0);
+	bytea *after = PG_GETARG_BYTEA_PP(1);
+
+	superuser_check();
+
+	pg_buffer_residency_diff_internals(fcinfo, before, after);
+
+	return (Datum) 0;
+}
+
+/*
+ * Occupancy and lock waits of the buffer mapping partitions
+ */
+Datum
+pg_buffer_mapping_partitions(PG_FUNCTION_ARGS)
+{
+	int32 topRelations = PG_GETARG_INT32(0);
+	int32 sampleTime = PG_GETARG_INT32(1);
+
+	superuser_check();
+
+	pg_buffer_mapping_partitions_internals(fcinfo, topRelations, sampleTime);
+
+	return (Datum) 0;
+}
+
+/*
+ * Bitmap of the cached blocks of a relation fork
+ */
+Datum
+pg_relation_residency_bitmap(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	text		*forkName = PG_GETARG_TEXT_PP(1);
+	bool		compress = PG_GETARG_BOOL(2);
+
+	superuser_check();
+
+	PG_RETURN_BYTEA_P(pg_relation_residency_bitmap_internals(relid, forkName, compress));
+}
+
+/*
+ * Number of cached blocks in a residency bitmap
+ */
+Datum
+pg_residency_bitmap_count(PG_FUNCTION_ARGS)
+{
+	bytea *bitmap = PG_GETARG_BYTEA_PP(0);
+
+	PG_RETURN_INT64(pg_residency_bitmap_count_internals(bitmap));
+}
+
+/*
+ * Blocks cached in both residency bitmaps
+ */
+Datum
+pg_residency_bitmap_and(PG_FUNCTION_ARGS)
+{
+	bytea *a = PG_GETARG_BYTEA_PP(0);
+	bytea *b = PG_GETARG_BYTEA_PP(1);
+
+	PG_RETURN_BYTEA_P(pg_residency_bitmap_and_internals(a, b));
+}
+
+/*
+ * Blocks cached in the first residency bitmap but not in the second
+ */
+Datum
+pg_residency_bitmap_diff(PG_FUNCTION_ARGS)
+{
+	bytea *a = PG_GETARG_BYTEA_PP(0);
+	bytea *b = PG_GETARG_BYTEA_PP(1);
+
+	PG_RETURN_BYTEA_P(pg_residency_bitmap_diff_internals(a, b));
+}
+
+/*
+ * Take a sample of the buffer cache for the hit ratio estimator
+ */
+Datum
+pg_buffer_mrc_sample(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	PG_RETURN_INT64(bct_mrc_sample());
+}
+
+/*
+ * Forget the samples of the hit ratio estimator
+ */
+Datum
+pg_buffer_mrc_reset(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	bct_mrc_reset();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Estimated hit ratio as a function of the cache size
+ */
+Datum
+pg_buffer_mrc(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	pg_buffer_mrc_internals(fcinfo);
+
+	return (Datum) 0;
+}
+
+/*
+ * Count the cached pages in the hottest blocks sketch
+ */
+Datum
+pg_buffer_hot_blocks_sample(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	PG_RETURN_INT64(bct_hot_blocks_sample());
+}
+
+/*
+ * Forget the counts of the hottest blocks sketch
+ */
+Datum
+pg_buffer_hot_blocks_reset(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	bct_hot_blocks_reset();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * The hottest blocks with their estimated hotness
+ */
+Datum
+pg_buffer_hot_blocks(PG_FUNCTION_ARGS)
+{
+	int32 nblocks = PG_GETARG_INT32(0);
+
+	superuser_check();
+
+	pg_buffer_hot_blocks_internals(fcinfo, nblocks);
+
+	return (Datum) 0;
+}
+
+/*
+ * Flush dirty buffers whose page LSN is at or below the given LSN
+ */
+Datum
+pg_flush_buffers_older_than(PG_FUNCTION_ARGS)
+{
+	XLogRecPtr	lsn;
+	text		*relName = PG_ARGISNULL(1) ? NULL : PG_GETARG_TEXT_PP(1);
+	text		*forkName = PG_ARGISNULL(2) ? NULL : PG_GETARG_TEXT_PP(2);
+	Oid			dbOid = PG_ARGISNULL(3) ? InvalidOid : PG_GETARG_OID(3);
+	Oid			spcOid = PG_ARGISNULL(4) ? InvalidOid : PG_GETARG_OID(4);
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	lsn = PG_GETARG_LSN(0);
+
+	superuser_check();
+
+	if (!PG_ARGISNULL(3) && database_is_invalid_oid(dbOid))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("invalid database oid")));
+
+	PG_RETURN_INT64(pg_flush_buffers_older_than_internals(lsn, relName, forkName, 
+														  dbOid, spcOid));
+}
+
+/*
+ * Run a buffer sweep in a background worker, returns the job id
+ */
+Datum
+pg_buffercache_tools_submit(PG_FUNCTION_ARGS)
+{
+	BufProcFunc	buf_proc_func;
+	char		*scopeName;
+	Oid			target = PG_ARGISNULL(2) ? InvalidOid : PG_GETARG_OID(2);
+	text		*forkName = PG_ARGISNULL(3) ? NULL : PG_GETARG_TEXT_PP(3);
+	int64		arg = PG_ARGISNULL(4) ? 0 : PG_GETARG_INT64(4);
+
+	superuser_check();
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				errmsg("mode and scope must not be null")));
+
+	buf_proc_func = buf_proc_func_name_to_number(text_to_cstring(PG_GETARG_TEXT_PP(0)));
+	scopeName = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	PG_RETURN_INT64(bct_job_submit(buf_proc_func, scopeName, !PG_ARGISNULL(2), target, 
+								   forkName, !PG_ARGISNULL(4), arg));
+}
+
+/*
+ * Cancel a queued or running job
+ */
+Datum
+pg_buffercache_tools_cancel(PG_FUNCTION_ARGS)
+{
+	int64 jobId = PG_GETARG_INT64(0);
+
+	superuser_check();
+
+	PG_RETURN_BOOL(bct_job_cancel(jobId));
+}
+
+/*
+ * Status, progress and results of submitted jobs
+ */
+Datum
+pg_buffercache_tools_jobs(PG_FUNCTION_ARGS)
+{
+	superuser_check();
+
+	pg_buffercache_tools_jobs_internals(fcinfo);
+
+	return (Datum) 0;
+}
@@ -0,0 +1,1062 @@
+/*-------------------------------------------------------------------------
+ *
+ * buffercache_tools_estimators.c
+ *
+ * 		Estimation of the buffer cache hit ratio for other cache sizes
+ * 		and of the hottest blocks
+ *
+ * The estimator samples buffer descriptors periodically. A sampled page
+ * is considered referenced if it appeared in the cache or its usage
+ * count grew since the previous round. Reuse distances of the references
+ * are tracked on a hashed subset of tags (as in SHARDS): a tag is
+ * tracked if its hash is below a threshold, and the distances are
+ * scaled by the inverse of the sampling rate. The number of distinct
+ * tags referenced since the previous reference of a tag is counted
+ * with a Fenwick tree over logical reference times.
+ *
+ * The hottest blocks are counted with a Space-Saving sketch of a fixed
+ * number of counters. Each sampled page adds its usage count and pin
+ * count to the counter of its tag. A tag that has no counter takes over
+ * the smallest one, found with a min-heap, and inherits its count as
+ * the possible overestimation.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "buffercache_tools_internals.h"
+
+#include "common/relpath.h"
+#include "miscadmin.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/tuplestore.h"
+
+/*
+ * Histogram of scaled reuse distances:
+ * BCT_MRC_NBUCKETS buckets of NBuffers / BCT_MRC_BUCKETS_PER_NBUFFERS pages,
+ * that is, the curve covers cache sizes up to 4 * shared_buffers
+ */
+#define BCT_MRC_BUCKETS_PER_NBUFFERS	64
+#define BCT_MRC_NBUCKETS				256
+
+/*
+ * Number of databases with their own curve, references
+ * to the pages of other databases are counted only in the total
+ */
+#define BCT_MRC_MAX_DATABASES	32
+
+/*
+ * Number of sampled pages collected without the estimator lock
+ * before they are registered under it
+ */
+#define BCT_SAMPLE_BATCH_SIZE	1024
+
+#define PG_BUFFER_MRC_COLS	4
+#define PG_BUFFER_HOT_BLOCKS_COLS	7
+
+#ifndef tuplestore_donestoring
+#define tuplestore_donestoring(state) 	((void) 0)
+#endif
+
+/*
+ * Sampled tag
+ */
+typedef struct BctMrcEntry {
+	BufferTag	tag;			/* hash key, must be first */
+	uint32		last_time;		/* logical time of the last reference */
+	uint32		last_round;		/* last round the page was cached in */
+	uint8		usagecount;		/* usage count seen in last_round */
+} BctMrcEntry;
+
+/*
+ * Sampled page collected before the estimator lock is taken
+ */
+typedef struct BctMrcSample {
+	BufferTag	tag;
+	uint8		usagecount;
+} BctMrcSample;
+
+/*
+ * Reuse distance histogram
+ */
+typedef struct BctMrcHistogram {
+	Oid			dbOid;
+	uint64		references;
+	uint64		cold_misses;
+	uint64		overflow;
+	uint64		hist[BCT_MRC_NBUCKETS];
+} BctMrcHistogram;
+
+typedef struct BctMrcShared {
+	uint32			threshold;		/* tag is sampled if hash >> 16 is below */
+	uint32			bucket_pages;
+	uint32			tree_size;		/* number of logical times in the tree */
+	uint32			clock;			/* last used logical time */
+	uint32			round;
+	int				ndatabases;
+	BctMrcHistogram	total;
+	BctMrcHistogram	databases[BCT_MRC_MAX_DATABASES];
+} BctMrcShared;
+
+/*
+ * Space-Saving counter
+ */
+typedef struct BctHotEntry {
+	BufferTag	tag;
+	uint64		count;			/* estimated hotness */
+	uint64		error;			/* maximum overestimation of count */
+	uint32		heap_pos;		/* position in the min-heap */
+} BctHotEntry;
+
+/*
+ * Counter of a tag
+ */
+typedef struct BctHotTag {
+	BufferTag	tag;			/* hash key, must be first */
+	uint32		slot;
+} BctHotTag;
+
+/*
+ * Sampled page with its weight, collected before the estimator lock is taken
+ */
+typedef struct BctHotSample {
+	BufferTag	tag;
+	uint32		weight;
+} BctHotSample;
+
+typedef struct BctHotShared {
+	uint32		nentries;
+	uint64		rounds;
+	uint64		observed;		/* sum of all observed weights */
+} BctHotShared;
+
+/*
+ * GUC variables
+ */
+double	bct_mrc_sample_rate = 0.01;
+int		bct_mrc_max_tracked = 0;
+int		bct_mrc_sample_interval = 0;
+int		bct_hot_blocks_max_tracked = 0;
+int		bct_hot_blocks_sample_interval = 0;
+
+static BctMrcShared *bctMrc = NULL;
+static uint32 *bctMrcTree = NULL;		/* Fenwick tree, 1-based */
+static BufferTag *bctMrcOwners = NULL;	/* tag referenced at each time */
+static HTAB *bctMrcTags = NULL;
+
+static BctHotShared *bctHot = NULL;
+static BctHotEntry *bctHotEntries = NULL;
+static uint32 *bctHotHeap = NULL;		/* slots ordered by count */
+static HTAB *bctHotTags = NULL;
+
+static void mrc_enabled_check(void);
+static void mrc_tree_add(uint32 time, int32 delta);
+static uint32 mrc_tree_sum(uint32 time);
+static uint32 mrc_tree_oldest(void);
+static void mrc_compact(void);
+static void mrc_touch(BctMrcEntry *entry);
+static int	mrc_entry_time_comparator(const void *a, const void *b);
+static BctMrcHistogram *mrc_database_histogram(Oid dbOid);
+static void mrc_count(BctMrcHistogram *dbHist, int64 bucket, uint64 count);
+static void mrc_reference(BctMrcEntry *entry, BctMrcHistogram *dbHist,
+						  bool cold, uint32 hits);
+static int64 mrc_register_samples(BctMrcSample *samples, int nsamples, uint32 round);
+static void mrc_put_curve(Tuplestorestate *tupstore, TupleDesc tupdesc,
+						  BctMrcHistogram *histogram, bool isTotal);
+static void hot_enabled_check(void);
+static void hot_heap_swap(uint32 a, uint32 b);
+static void hot_heap_sift_up(uint32 pos);
+static void hot_heap_sift_down(uint32 pos);
+static void hot_observe(BufferTag *tag, uint64 weight);
+static void hot_register_samples(BctHotSample *samples, int nsamples);
+static int	hot_entry_count_comparator(const void *a, const void *b);
+
+/*-------------------------------------------------------------------------
+ * 							Shared memory setup
+ *-------------------------------------------------------------------------
+ */
+
+static Size
+mrc_tree_size(void)
+{
+	/* Twice the tracked tags, so compaction is needed rarely */
+	return (Size) bct_mrc_max_tracked * 2;
+}
+
+Size
+bct_mrc_shmem_size(void)
+{
+	Size size;
+
+	if (bct_mrc_max_tracked <= 0)
+		return 0;
+
+	size = MAXALIGN(sizeof(BctMrcShared));
+	size = add_size(size, MAXALIGN(mul_size(mrc_tree_size() + 1, sizeof(uint32))));
+	size = add_size(size, MAXALIGN(mul_size(mrc_tree_size() + 1, sizeof(BufferTag))));
+	size = add_size(size, hash_estimate_size(bct_mrc_max_tracked, sizeof(BctMrcEntry)));
+
+	return size;
+}
+
+/*
+ * Called from the shmem startup hook under AddinShmemInitLock
+ */
+void
+bct_mrc_shmem_startup(void)
+{
+	HASHCTL	info;
+	bool	found;
+	char	*ptr;
+
+	if (bct_mrc_max_tracked <= 0)
+		return;
+
+	ptr = ShmemInitStruct("buffercache_tools mrc",
+						  MAXALIGN(sizeof(BctMrcShared)) +
+						  MAXALIGN((mrc_tree_size() + 1) * sizeof(uint32)) +
+						  MAXALIGN((mrc_tree_size() + 1) * sizeof(BufferTag)),
+						  &found);
+
+	bctMrc = (BctMrcShared *) ptr;
+	ptr += MAXALIGN(sizeof(BctMrcShared));
+	bctMrcTree = (uint32 *) ptr;
+	ptr += MAXALIGN((mrc_tree_size() + 1) * sizeof(uint32));
+	bctMrcOwners = (BufferTag *) ptr;
+
+	if (!found)
+	{
+		memset(bctMrc, 0, sizeof(BctMrcShared));
+		memset(bctMrcTree, 0, (mrc_tree_size() + 1) * sizeof(uint32));
+		bctMrc->threshold = Max((uint32) (bct_mrc_sample_rate * 65536.0), 1);
+		bctMrc->bucket_pages = Max(NBuffers / BCT_MRC_BUCKETS_PER_NBUFFERS, 1);
+		bctMrc->tree_size = (uint32) mrc_tree_size();
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(BufferTag);
+	info.entrysize = sizeof(BctMrcEntry);
+
+	bctMrcTags = ShmemInitHash("buffercache_tools mrc tags",
+							   bct_mrc_max_tracked, bct_mrc_max_tracked,
+							   &info, HASH_ELEM | HASH_BLOBS);
+}
+
+static void
+mrc_enabled_check(void)
+{
+	if (bctMrc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("hit ratio estimation is not enabled"),
+				 errhint("Add buffercache_tools to shared_preload_libraries "
+						 "and set buffercache_tools.mrc_max_tracked.")));
+}
+
+/*-------------------------------------------------------------------------
+ * 							Reuse distance tracking
+ *-------------------------------------------------------------------------
+ */
+
+static void
+mrc_tree_add(uint32 time, int32 delta)
+{
+	for (; time <= bctMrc->tree_size; time += time & (~time + 1))
+		bctMrcTree[time] += delta;
+}
+
+/*
+ * Number of tags whose last reference time is not later than time
+ */
+static uint32
+mrc_tree_sum(uint32 time)
+{
+	uint32 sum = 0;
+
+	for (; time > 0; time -= time & (~time + 1))
+		sum += bctMrcTree[time];
+
+	return sum;
+}
+
+/*
+ * Time of the least recently referenced tag
+ */
+static uint32
+mrc_tree_oldest(void)
+{
+	uint32 pos = 0;
+	uint32 step = 1;
+
+	while (step * 2 <= bctMrc->tree_size)
+		step *= 2;
+
+	for (; step > 0; step /= 2)
+	{
+		if (pos + step <= bctMrc->tree_size && bctMrcTree[pos + step] == 0)
+			pos += step;
+	}
+
+	return pos + 1;
+}
+
+static int
+mrc_entry_time_comparator(const void *a, const void *b)
+{
+	uint32 ta = (*(BctMrcEntry * const *) a)->last_time;
+	uint32 tb = (*(BctMrcEntry * const *) b)->last_time;
+
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Renumber reference times 1..n when the tree is out of times
+ */
+static void
+mrc_compact(void)
+{
+	HASH_SEQ_STATUS	status;
+	BctMrcEntry		**entries;
+	BctMrcEntry		*entry;
+	long			n = 0;
+	long			i;
+
+	entries = palloc(sizeof(BctMrcEntry *) * Max(hash_get_num_entries(bctMrcTags), 1));
+
+	/* A new tag that is not referenced yet has no time */
+	hash_seq_init(&status, bctMrcTags);
+	while ((entry = (BctMrcEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->last_time != 0)
+			entries[n++] = entry;
+	}
+
+	qsort(entries, n, sizeof(BctMrcEntry *), mrc_entry_time_comparator);
+
+	memset(bctMrcTree, 0, (bctMrc->tree_size + 1) * sizeof(uint32));
+
+	for (i = 0; i < n; i++)
+	{
+		entries[i]->last_time = (uint32) i + 1;
+		bctMrcOwners[i + 1] = entries[i]->tag;
+		mrc_tree_add((uint32) i + 1, 1);
+	}
+
+	bctMrc->clock = (uint32) n;
+
+	pfree(entries);
+}
+
+/*
+ * Give the tag the next logical time
+ */
+static void
+mrc_touch(BctMrcEntry *entry)
+{
+	if (bctMrc->clock == bctMrc->tree_size)
+		mrc_compact();
+
+	entry->last_time = ++bctMrc->clock;
+	bctMrcOwners[entry->last_time] = entry->tag;
+	mrc_tree_add(entry->last_time, 1);
+}
+
+/*
+ * Histogram of a database, NULL if there are too many databases
+ */
+static BctMrcHistogram *
+mrc_database_histogram(Oid dbOid)
+{
+	int i;
+
+	for (i = 0; i < bctMrc->ndatabases; i++)
+	{
+		if (bctMrc->databases[i].dbOid == dbOid)
+			return &bctMrc->databases[i];
+	}
+
+	if (bctMrc->ndatabases == BCT_MRC_MAX_DATABASES)
+		return NULL;
+
+	bctMrc->databases[bctMrc->ndatabases].dbOid = dbOid;
+	return &bctMrc->databases[bctMrc->ndatabases++];
+}
+
+/*
+ * Count references with the scaled distance in bucket.
+ * Negative bucket is a cold miss.
+ */
+static void
+mrc_count(BctMrcHistogram *dbHist, int64 bucket, uint64 count)
+{
+	BctMrcHistogram *histograms[2] = {&bctMrc->total, dbHist};
+	int i;
+
+	for (i = 0; i < lengthof(histograms); i++)
+	{
+		BctMrcHistogram *histogram = histograms[i];
+
+		if (histogram == NULL)
+			continue;
+
+		histogram->references += count;
+		if (bucket < 0)
+			histogram->cold_misses += count;
+		else if (bucket >= BCT_MRC_NBUCKETS)
+			histogram->overflow += count;
+		else
+			histogram->hist[bucket] += count;
+	}
+}
+
+/*
+ * Register a reference of the tracked tag followed by hits more
+ * references seen as the growth of its usage count
+ */
+static void
+mrc_reference(BctMrcEntry *entry, BctMrcHistogram *dbHist, bool cold, uint32 hits)
+{
+	if (bctMrc->clock == bctMrc->tree_size)
+		mrc_compact();
+
+	if (cold)
+		mrc_count(dbHist, -1, 1);
+	else
+	{
+		uint64 distance;
+
+		distance = mrc_tree_sum(bctMrc->clock) - mrc_tree_sum(entry->last_time);
+		mrc_tree_add(entry->last_time, -1);
+
+		/* Scale the distance by the inverse of the sampling rate */
+		distance = distance * 65536 / bctMrc->threshold;
+		mrc_count(dbHist, (int64) (distance / bctMrc->bucket_pages), 1);
+	}
+
+	/* Other references happened since the page had been referenced */
+	if (hits > 0)
+		mrc_count(dbHist, 0, hits);
+
+	mrc_touch(entry);
+}
+
+/*
+ * Register references of a batch of sampled pages.
+ * BCT_LWLOCK_MRC must be held exclusively.
+ */
+static int64
+mrc_register_samples(BctMrcSample *samples, int nsamples, uint32 round)
+{
+	int64	nreferences = 0;
+	int		i;
+
+	for (i = 0; i < nsamples; i++)
+	{
+		BufferTag			*tag = &samples[i].tag;
+		uint32				usagecount = samples[i].usagecount;
+		BctMrcEntry			*entry;
+		BctMrcHistogram		*dbHist;
+		bool				found;
+
+		entry = (BctMrcEntry *) hash_search(bctMrcTags, tag, HASH_FIND, NULL);
+
+		/* Evict the least recently referenced tag to track a new one */
+		if (entry == NULL &&
+			hash_get_num_entries(bctMrcTags) >= bct_mrc_max_tracked)
+		{
+			uint32 oldest = mrc_tree_oldest();
+
+			mrc_tree_add(oldest, -1);
+			hash_search(bctMrcTags, &bctMrcOwners[oldest], HASH_REMOVE, NULL);
+		}
+
+		if (entry == NULL)
+		{
+			entry = (BctMrcEntry *) hash_search(bctMrcTags, tag, HASH_ENTER, &found);
+			entry->last_time = 0;
+		}
+		else
+			found = true;
+
+		dbHist = mrc_database_histogram(BCT_BUFTAG_DBOID(*tag));
+
+		if (round == 1)
+		{
+			/* The first round only seeds the tracked tags */
+			if (entry->last_time != 0)
+			{
+				mrc_tree_add(entry->last_time, -1);
+				entry->last_time = 0;
+			}
+			mrc_touch(entry);
+		}
+		else if (!found || entry->last_round != round - 1)
+		{
+			/* The page was read into the cache since the previous round */
+			mrc_reference(entry, dbHist, !found, Max(usagecount, 1) - 1);
+			nreferences += Max(usagecount, 1);
+		}
+		else if (usagecount > entry->usagecount)
+		{
+			mrc_reference(entry, dbHist, false, usagecount - entry->usagecount - 1);
+			nreferences += usagecount - entry->usagecount;
+		}
+
+		entry->usagecount = (uint8) usagecount;
+		entry->last_round = round;
+	}
+
+	return nreferences;
+}
+
+/*
+ * Scan buffer descriptors and register references of sampled tags.
+ * Returns the number of registered references.
+ *
+ * The descriptors are read without the estimator lock, which is taken
+ * only to register each batch of sampled pages, so the scan can be
+ * cancelled and pg_buffer_mrc() does not wait for the whole scan.
+ */
+int64
+bct_mrc_sample(void)
+{
+	BctMrcSample	*samples;
+	int				nsamples = 0;
+	int64			nreferences = 0;
+	uint32			threshold;
+	uint32			round;
+	int				i;
+
+	mrc_enabled_check();
+
+	samples = palloc(sizeof(BctMrcSample) * BCT_SAMPLE_BATCH_SIZE);
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_MRC), LW_EXCLUSIVE);
+	round = ++bctMrc->round;
+	threshold = bctMrc->threshold;
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_MRC));
+
+	for (i = 0; i < NBuffers; i++)
+	{
+		BufferDesc	*bufHdr;
+		uint32		bufState;
+		BufferTag	tag;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+
+		/* Skip free buffers without taking the header lock */
+		bufState = pg_atomic_read_u32(&bufHdr->state);
+		if (!(BUFFER_IS_VALID(bufState)))
+			continue;
+
+		bufState = LockBufHdr(bufHdr);
+		tag = bufHdr->tag;
+		UnlockBufHdr(bufHdr, bufState);
+
+		if (!(BUFFER_IS_VALID(bufState)))
+			continue;
+
+		if ((BufTableHashCode(&tag) >> 16) >= threshold)
+			continue;
+
+		samples[nsamples].tag = tag;
+		samples[nsamples].usagecount = (uint8) BUF_STATE_GET_USAGECOUNT(bufState);
+		nsamples++;
+
+		if (nsamples == BCT_SAMPLE_BATCH_SIZE)
+		{
+			LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_MRC), LW_EXCLUSIVE);
+			nreferences += mrc_register_samples(samples, nsamples, round);
+			LWLockRelease(bct_get_lwlock(BCT_LWLOCK_MRC));
+
+			nsamples = 0;
+		}
+	}
+
+	if (nsamples > 0)
+	{
+		LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_MRC), LW_EXCLUSIVE);
+		nreferences += mrc_register_samples(samples, nsamples, round);
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_MRC));
+	}
+
+	pfree(samples);
+
+	return nreferences;
+}
+
+/*
+ * Forget tracked tags and collected references
+ */
+void
+bct_mrc_reset(void)
+{
+	HASH_SEQ_STATUS	status;
+	BctMrcEntry		*entry;
+
+	mrc_enabled_check();
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_MRC), LW_EXCLUSIVE);
+
+	hash_seq_init(&status, bctMrcTags);
+	while ((entry = (BctMrcEntry *) hash_seq_search(&status)) != NULL)
+		hash_search(bctMrcTags, &entry->tag, HASH_REMOVE, NULL);
+
+	memset(bctMrcTree, 0, (bctMrc->tree_size + 1) * sizeof(uint32));
+	bctMrc->clock = 0;
+	bctMrc->round = 0;
+	bctMrc->ndatabases = 0;
+	memset(&bctMrc->total, 0, sizeof(BctMrcHistogram));
+	memset(bctMrc->databases, 0, sizeof(bctMrc->databases));
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_MRC));
+}
+
+/*-------------------------------------------------------------------------
+ * 							Miss ratio curve output
+ *-------------------------------------------------------------------------
+ */
+
+static void
+mrc_put_curve(Tuplestorestate *tupstore, TupleDesc tupdesc,
+			  BctMrcHistogram *histogram, bool isTotal)
+{
+	Datum	values[PG_BUFFER_MRC_COLS];
+	bool	nulls[PG_BUFFER_MRC_COLS] = {0};
+	uint64	hits = 0;
+	int		i;
+
+	if (histogram->references == 0)
+		return;
+
+	for (i = 0; i < BCT_MRC_NBUCKETS; i++)
+	{
+		hits += histogram->hist[i];
+
+		nulls[0] = isTotal;
+		values[0] = ObjectIdGetDatum(histogram->dbOid);
+		values[1] = Int64GetDatum((int64) (i + 1) * bctMrc->bucket_pages * BLCKSZ);
+		values[2] = Float8GetDatum((double) hits / histogram->references);
+		values[3] = Int64GetDatum((int64) histogram->references);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+}
+
+/*
+ * Estimated hit ratio for cache sizes up to 4 * shared_buffers,
+ * overall (datid is NULL) and per database
+ */
+void
+pg_buffer_mrc_internals(FunctionCallInfo fcinfo)
+{
+	int i;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	mrc_enabled_check();
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_MRC), LW_SHARED);
+
+	mrc_put_curve(tupstore, tupdesc, &bctMrc->total, true);
+	for (i = 0; i < bctMrc->ndatabases; i++)
+		mrc_put_curve(tupstore, tupdesc, &bctMrc->databases[i], false);
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_MRC));
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+bool
+bct_mrc_enabled(void)
+{
+	return bctMrc != NULL;
+}
+
+/*-------------------------------------------------------------------------
+ * 							Hottest blocks sketch
+ *-------------------------------------------------------------------------
+ */
+
+Size
+bct_hot_blocks_shmem_size(void)
+{
+	Size size;
+
+	if (bct_hot_blocks_max_tracked <= 0)
+		return 0;
+
+	size = MAXALIGN(sizeof(BctHotShared));
+	size = add_size(size, MAXALIGN(mul_size(bct_hot_blocks_max_tracked, sizeof(BctHotEntry))));
+	size = add_size(size, MAXALIGN(mul_size(bct_hot_blocks_max_tracked, sizeof(uint32))));
+	size = add_size(size, hash_estimate_size(bct_hot_blocks_max_tracked, sizeof(BctHotTag)));
+
+	return size;
+}
+
+/*
+ * Called from the shmem startup hook under AddinShmemInitLock
+ */
+void
+bct_hot_blocks_shmem_startup(void)
+{
+	HASHCTL	info;
+	bool	found;
+	char	*ptr;
+
+	if (bct_hot_blocks_max_tracked <= 0)
+		return;
+
+	ptr = ShmemInitStruct("buffercache_tools hot blocks",
+						  MAXALIGN(sizeof(BctHotShared)) +
+						  MAXALIGN(bct_hot_blocks_max_tracked * sizeof(BctHotEntry)) +
+						  MAXALIGN(bct_hot_blocks_max_tracked * sizeof(uint32)),
+						  &found);
+
+	bctHot = (BctHotShared *) ptr;
+	ptr += MAXALIGN(sizeof(BctHotShared));
+	bctHotEntries = (BctHotEntry *) ptr;
+	ptr += MAXALIGN(bct_hot_blocks_max_tracked * sizeof(BctHotEntry));
+	bctHotHeap = (uint32 *) ptr;
+
+	if (!found)
+		memset(bctHot, 0, sizeof(BctHotShared));
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(BufferTag);
+	info.entrysize = sizeof(BctHotTag);
+
+	bctHotTags = ShmemInitHash("buffercache_tools hot blocks tags",
+							   bct_hot_blocks_max_tracked, bct_hot_blocks_max_tracked,
+							   &info, HASH_ELEM | HASH_BLOBS);
+}
+
+static void
+hot_enabled_check(void)
+{
+	if (bctHot == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("hot blocks tracking is not enabled"),
+				 errhint("Add buffercache_tools to shared_preload_libraries "
+						 "and set buffercache_tools.hot_blocks_max_tracked.")));
+}
+
+static void
+hot_heap_swap(uint32 a, uint32 b)
+{
+	uint32 slot = bctHotHeap[a];
+
+	bctHotHeap[a] = bctHotHeap[b];
+	bctHotHeap[b] = slot;
+	bctHotEntries[bctHotHeap[a]].heap_pos = a;
+	bctHotEntries[bctHotHeap[b]].heap_pos = b;
+}
+
+static void
+hot_heap_sift_up(uint32 pos)
+{
+	while (pos > 0)
+	{
+		uint32 parent = (pos - 1) / 2;
+
+		if (bctHotEntries[bctHotHeap[parent]].count <= bctHotEntries[bctHotHeap[pos]].count)
+			break;
+
+		hot_heap_swap(pos, parent);
+		pos = parent;
+	}
+}
+
+static void
+hot_heap_sift_down(uint32 pos)
+{
+	for (;;)
+	{
+		uint32 smallest = pos;
+		uint32 child = pos * 2 + 1;
+		uint32 i;
+
+		for (i = child; i < child + 2 && i < bctHot->nentries; i++)
+		{
+			if (bctHotEntries[bctHotHeap[i]].count < bctHotEntries[bctHotHeap[smallest]].count)
+				smallest = i;
+		}
+
+		if (smallest == pos)
+			break;
+
+		hot_heap_swap(pos, smallest);
+		pos = smallest;
+	}
+}
+
+/*
+ * Add weight to the counter of the tag
+ */
+static void
+hot_observe(BufferTag *tag, uint64 weight)
+{
+	BctHotTag	*hotTag;
+	BctHotEntry	*entry;
+	uint32		slot;
+	bool		found;
+
+	hotTag = (BctHotTag *) hash_search(bctHotTags, tag, HASH_FIND, NULL);
+
+	if (hotTag != NULL)
+	{
+		entry = &bctHotEntries[hotTag->slot];
+		entry->count += weight;
+		hot_heap_sift_down(entry->heap_pos);
+		return;
+	}
+
+	if (bctHot->nentries < (uint32) bct_hot_blocks_max_tracked)
+	{
+		slot = bctHot->nentries++;
+		entry = &bctHotEntries[slot];
+		entry->count = weight;
+		entry->error = 0;
+		entry->heap_pos = slot;
+		bctHotHeap[slot] = slot;
+	}
+	else
+	{
+		/* Take over the smallest counter */
+		slot = bctHotHeap[0];
+		entry = &bctHotEntries[slot];
+		hash_search(bctHotTags, &entry->tag, HASH_REMOVE, NULL);
+		entry->error = entry->count;
+		entry->count += weight;
+	}
+
+	entry->tag = *tag;
+	hotTag = (BctHotTag *) hash_search(bctHotTags, tag, HASH_ENTER, &found);
+	hotTag->slot = slot;
+
+	if (entry->error == 0)
+		hot_heap_sift_up(entry->heap_pos);
+	else
+		hot_heap_sift_down(entry->heap_pos);
+}
+
+/*
+ * Count a batch of sampled pages, BCT_LWLOCK_HOT_BLOCKS must be held
+ * exclusively
+ */
+static void
+hot_register_samples(BctHotSample *samples, int nsamples)
+{
+	int i;
+
+	for (i = 0; i < nsamples; i++)
+		hot_observe(&samples[i].tag, samples[i].weight);
+}
+
+/*
+ * Scan buffer descriptors and count each cached page with its usage count
+ * and pin count. Returns the sum of the counted weights.
+ *
+ * The pages are collected without the lock and counted in batches, so
+ * readers of the counters do not wait for the whole scan.
+ */
+int64
+bct_hot_blocks_sample(void)
+{
+	BctHotSample	*samples;
+	int				nsamples = 0;
+	int64			observed = 0;
+	int				i;
+
+	hot_enabled_check();
+
+	samples = palloc(sizeof(BctHotSample) * BCT_SAMPLE_BATCH_SIZE);
+
+	for (i = 0; i < NBuffers; i++)
+	{
+		BufferDesc	*bufHdr;
+		uint32		bufState;
+		uint32		weight;
+		BufferTag	tag;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+
+		/* Skip free and cold buffers without taking the header lock */
+		bufState = pg_atomic_read_u32(&bufHdr->state);
+		if (!(BUFFER_IS_VALID(bufState)) ||
+			BUF_STATE_GET_USAGECOUNT(bufState) + BUF_STATE_GET_REFCOUNT(bufState) == 0)
+			continue;
+
+		bufState = LockBufHdr(bufHdr);
+		tag = bufHdr->tag;
+		UnlockBufHdr(bufHdr, bufState);
+
+		weight = BUF_STATE_GET_USAGECOUNT(bufState) + BUF_STATE_GET_REFCOUNT(bufState);
+
+		if (!(BUFFER_IS_VALID(bufState)) || weight == 0)
+			continue;
+
+		samples[nsamples].tag = tag;
+		samples[nsamples].weight = weight;
+		nsamples++;
+		observed += weight;
+
+		if (nsamples == BCT_SAMPLE_BATCH_SIZE)
+		{
+			LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS), LW_EXCLUSIVE);
+			hot_register_samples(samples, nsamples);
+			LWLockRelease(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS));
+
+			nsamples = 0;
+		}
+	}
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS), LW_EXCLUSIVE);
+	hot_register_samples(samples, nsamples);
+	bctHot->rounds++;
+	bctHot->observed += observed;
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS));
+
+	pfree(samples);
+
+	return observed;
+}
+
+/*
+ * Forget the counted blocks
+ */
+void
+bct_hot_blocks_reset(void)
+{
+	uint32 i;
+
+	hot_enabled_check();
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS), LW_EXCLUSIVE);
+
+	for (i = 0; i < bctHot->nentries; i++)
+		hash_search(bctHotTags, &bctHotEntries[i].tag, HASH_REMOVE, NULL);
+
+	memset(bctHot, 0, sizeof(BctHotShared));
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS));
+}
+
+static int
+hot_entry_count_comparator(const void *a, const void *b)
+{
+	const BctHotEntry *ea = (const BctHotEntry *) a;
+	const BctHotEntry *eb = (const BctHotEntry *) b;
+
+	if (ea->count != eb->count)
+		return ea->count > eb->count ? -1 : 1;
+	return 0;
+}
+
+/*
+ * The nblocks hottest blocks with their estimated hotness, the sum of
+ * the usage and pin counts over the samples. The true value lies between
+ * hotness - max_error and hotness.
+ */
+void
+pg_buffer_hot_blocks_internals(FunctionCallInfo fcinfo, int32 nblocks)
+{
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	BctHotEntry		*entries;
+	uint32			nentries;
+	uint32			i;
+
+	hot_enabled_check();
+
+	if (nblocks <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("number of blocks must be positive")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Copy the counters so the lock is not held while sorting */
+	entries = palloc(sizeof(BctHotEntry) * Max(bct_hot_blocks_max_tracked, 1));
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS), LW_SHARED);
+
+	nentries = bctHot->nentries;
+	memcpy(entries, bctHotEntries, sizeof(BctHotEntry) * nentries);
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_HOT_BLOCKS));
+
+	qsort(entries, nentries, sizeof(BctHotEntry), hot_entry_count_comparator);
+
+	for (i = 0; i < nentries && i < (uint32) nblocks; i++)
+	{
+		Datum	values[PG_BUFFER_HOT_BLOCKS_COLS];
+		bool	nulls[PG_BUFFER_HOT_BLOCKS_COLS] = {0};
+
+		values[0] = ObjectIdGetDatum(BCT_BUFTAG_RELNUMBER(entries[i].tag));
+		values[1] = ObjectIdGetDatum(BCT_BUFTAG_DBOID(entries[i].tag));
+		values[2] = ObjectIdGetDatum(BCT_BUFTAG_SPCOID(entries[i].tag));
+		values[3] = CStringGetTextDatum(forkNames[entries[i].tag.forkNum]);
+		values[4] = Int64GetDatum((int64) entries[i].tag.blockNum);
+		values[5] = Int64GetDatum((int64) entries[i].count);
+		values[6] = Int64GetDatum((int64) entries[i].error);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(entries);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+}
+
+bool
+bct_hot_blocks_enabled(void)
+{
+	return bctHot != NULL;
+}
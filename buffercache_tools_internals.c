@@ -15,10 +15,19 @@
 
 #include "c.h"
 
+#include "access/htup_details.h"
+#include "access/nbtree.h"
 #include "access/relation.h"
+#include "access/xlog.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
 #include "common/relpath.h"
+#include "executor/instrument.h"
+#include "funcapi.h"
+#include "lib/binaryheap.h"
 #include "nodes/execnodes.h"
+#include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/buf_internals.h"
 
@@ -28,12 +37,22 @@
 #include "storage/relfilenode.h"
 #endif
 
+#include "storage/bufpage.h"
+#include "storage/freespace.h"
 #include "storage/lmgr.h"
+#include "storage/smgr.h"
+#include "utils/pg_lsn.h"
 #include "utils/relcache.h"
 #include "miscadmin.h"
+#include "utils/timestamp.h"
 #include "utils/tuplestore.h"
 #include "utils/varlena.h"
 
+/*
+ * Number of blocks added to a relation per ExtendBufferedRelBy() call
+ */
+#define BCT_EXTEND_BATCH_SIZE	64
+
 #ifdef PG_VERSION_NUM_EQUAL_OR_MORE_160000
 
 /*
@@ -100,6 +119,29 @@
 #define BUFFER_IS_VALID(_buf_state_) \
 	(_buf_state_ & BM_VALID) && (_buf_state_ & BM_TAG_VALID)
 
+/*
+ * is buffer dirty?
+ */
+#define BCT_BUFFER_IS_DIRTY(_bct_buffer_) \
+	(pg_atomic_read_u32(&GetBufferDescriptor((_bct_buffer_) - 1)->state) & BM_DIRTY)
+
+/*
+ * Is the buffer processing function a flush that collects
+ * the buffers first and writes them after the scan?
+ */
+#define BCT_BPF_IS_BULK_FLUSH(_bct_bpf_) \
+	((_bct_bpf_) == BCT_FLUSH || \
+	 (_bct_bpf_) == BCT_FLUSH_BALANCED || \
+	 (_bct_bpf_) == BCT_FLUSH_OLDER_THAN)
+
+/*
+ * LSN of the page in the buffer, read without the content lock.  The value
+ * may be stale or torn while the page is being changed, so it is only a hint:
+ * callers must recheck it under the content lock before acting on it.
+ */
+#define BCT_BUFFER_PAGE_LSN(_bct_bufHdr_) \
+	PageGetLSN(BufferGetPage(BufferDescriptorGetBuffer(_bct_bufHdr_)))
+
 /*
  * Lookup table of buffer processing function name by number 
  */
@@ -112,8 +154,117 @@ const char *const bufProcFuncNames[] = {
 	[BCT_CHANGE_FORKNUM] = "change_forknum",
 	[BCT_CHANGE_BLOCKNUM] = "change_blocknum",
 	[BCT_INVALIDATE] = "invalidate",
+	[BCT_FLUSH_BALANCED] = "flush_balanced",
+	[BCT_CHANGE_USAGECOUNT] = "change_usagecount",
+	[BCT_FLUSH_OLDER_THAN] = "flush_older_than",
+	[BCT_EVICT] = "evict",
+};
+
+/*
+ * Lookup table of buffer sweep coverage name by number
+ */
+const char *const bctScopeNames[] = {
+	[BCT_SCOPE_BUFFER] = "buffer",
+	[BCT_SCOPE_RELATION_FORK] = "relation_fork",
+	[BCT_SCOPE_RELATION] = "relation",
+	[BCT_SCOPE_DATABASE] = "database",
+	[BCT_SCOPE_TABLESPACE] = "tablespace",
+	[BCT_SCOPE_ALL_VALID] = "all_valid",
+	[BCT_SCOPE_PAGE] = "page",
 };
 
+/*
+ * Page header facts of a cached page
+ */
+typedef struct BctPageHeaderInfo {
+	XLogRecPtr	lsn;
+	uint16		checksum;
+	uint16		flags;
+	bool		is_new;
+	int			free_space;
+	int			line_pointers;
+} BctPageHeaderInfo;
+
+/*
+ * Aggregates of pg_relation_cached_pages_stats()
+ */
+typedef struct BctCachedPagesStats {
+	int64		cached_pages;
+	int64		dirty_pages;
+	int64		new_pages;
+	int64		all_visible_pages;
+	int64		free_lines_pages;
+	int64		free_space;
+	int64		line_pointers;
+	int64		lsn_older_pages;
+	XLogRecPtr	min_lsn;
+	XLogRecPtr	max_lsn;
+	bool		has_lsn_threshold;
+	XLogRecPtr	lsn_threshold;
+} BctCachedPagesStats;
+
+/*
+ * Buffers visited by a scan and the scan position.
+ * Which fields are used depends on the scope.
+ */
+typedef struct BctScan {
+	BctScope	scope;
+	bool		local;			/* local buffers of this backend */
+	Relation	rel;
+	ForkNumber	forkNum;
+	BlockNumber	blockNum;
+	Oid			dbOid;
+	Oid			spcOid;
+	int			next_buf_id;	/* the next buffer to visit */
+	int			end_buf_id;		/* one past the last buffer to visit */
+	uint32		state_mask;		/* state bits that must equal state_match */
+	uint32		state_match;
+	uint32		min_usagecount;
+} BctScan;
+
+/*
+ * Called for every matching buffer with its header locked,
+ * must unlock it. Returning false stops the scan.
+ * The headers of local buffers are not locked, see BCT_UNLOCK_BUF_HDR().
+ */
+typedef bool (*BctScanAction) (BufferDesc *bufHdr, uint32 bufState, void *arg);
+
+/*
+ * Unlock the header of a buffer passed to a scan action. Local buffers
+ * are used only by this backend, their headers are never locked.
+ */
+#define BCT_UNLOCK_BUF_HDR(_bct_bufHdr_, _bct_bufState_) \
+	do { \
+		if (!BufferIsLocal(BufferDescriptorGetBuffer(_bct_bufHdr_))) \
+			UnlockBufHdr((_bct_bufHdr_), (_bct_bufState_)); \
+	} while (0)
+
+/*
+ * Arguments of bct_scan_action_process()
+ */
+typedef struct BctScanProcessArgs {
+	BufProcFunc		buf_proc_func;
+	NullableDatum	*bpf_args;
+	int64			nprocessed;
+} BctScanProcessArgs;
+
+/*
+ * Arguments of bct_scan_action_local()
+ */
+typedef struct BctScanLocalArgs {
+	BufProcFunc		buf_proc_func;
+	SMgrRelation	smgr;
+	int64			nprocessed;
+} BctScanLocalArgs;
+
+/*
+ * Tuplestore the rows of a scan are put into
+ */
+typedef struct BctScanOutput {
+	Tuplestorestate	*tupstore;
+	TupleDesc		tupdesc;
+} BctScanOutput;
+
 /*
  * change buffer tag functions headers 
  */
@@ -126,12 +277,96 @@ static void change_relnumber_buffer(Buffer buffer, RelFileNumber relNumber);
 #endif  /* HAVE_RELFILENUMBERMAP_H */
 static void change_forknum_buffer(Buffer buffer, ForkNumber forkNum);
 static void change_blocknum_buffer(Buffer buffer, BlockNumber blockNum);
-static void invalidate_buffer(Buffer buffer);
+static bool invalidate_buffer(Buffer buffer);
+static void change_usagecount_buffer(Buffer buffer, uint32 usageCount);
 
 /* 
  * other functions headers 
  */
 static void BufProcFuncWrapper(int32 buf_proc_func, Buffer buffer, NullableDatum *bpf_args);
+static void flush_queue_init(BctFlushQueue *queue, BufProcFunc buf_proc_func, 
+							 NullableDatum *bpf_args);
+static void flush_queue_add(BctFlushQueue *queue, BufferTag *tag, uint32 bufState, 
+							XLogRecPtr lsn, int buf_id);
+static void flush_queue_write_item(BctFlushItem *item, BufProcFunc buf_proc_func, 
+								   NullableDatum *bpf_args);
+static void flush_queue_write_balanced(BctFlushQueue *queue, NullableDatum *bpf_args);
+static void flush_queue_execute(BctFlushQueue *queue, NullableDatum *bpf_args);
+static int	flush_item_comparator(const void *a, const void *b);
+static int	ts_flush_progress_comparator(Datum a, Datum b, void *arg);
+static void bct_scan_init(BctScan *scan, BctScope scope, bool local);
+static bool bct_scan_buffers(BctScan *scan, BctScanAction action, void *arg);
+static bool bct_scan_action_process(BufferDesc *bufHdr, uint32 bufState, void *arg);
+static bool bct_scan_action_queue_flush(BufferDesc *bufHdr, uint32 bufState, void *arg);
+static int64 bct_scan_process(BctScan *scan, BufProcFunc buf_proc_func, 
+							  NullableDatum *bpf_args);
+static bool bct_scan_action_local(BufferDesc *bufHdr, uint32 bufState, void *arg);
+static int64 bct_scan_process_local(BctScan *scan, BufProcFunc buf_proc_func);
+static bool read_cached_page_header(BufferDesc *bufHdr, BufferTag *tag, 
+									BctPageHeaderInfo *info);
+static int	block_number_comparator(const void *a, const void *b);
+static char *verify_cached_page(BufferDesc *bufHdr, BufferTag *tag);
+static void read_block_range(Relation rel, ForkNumber forkNum, 
+							 BlockNumber firstBlock, int nblocks);
+
+/*
+ * Filters and scan position of pg_show_buffers()
+ */
+typedef struct BctShowBuffersState {
+	BctScan		scan;
+	bool		filter_dboid;
+	Oid			dbOid;
+	bool		filter_spcoid;
+	Oid			spcOid;
+	bool		filter_relnumber;
+	Oid			relNumber;
+	bool		filter_fork;
+	ForkNumber	forkNum;
+	/* the buffer found by the last call */
+	Buffer		buffer;
+	BufferTag	tag;
+	uint32		bufState;
+} BctShowBuffersState;
+
+#define PG_SHOW_BUFFERS_COLS	9
+
+/*
+ * How far ahead of the reads prefetch requests are issued
+ */
+#define BCT_PREFETCH_DISTANCE	64
+
+#define PG_SHOW_BUFFER_PAGE_COLS			7
+#define PG_RELATION_CACHED_PAGES_STATS_COLS	10
+#define PG_REMAP_RELATION_BUFFERS_COLS		4
+#define PG_VERIFY_CACHED_PAGES_COLS			7
+#define PG_BUFFER_STRATEGY_COLS				11
+
+/*
+ * Clock sweep position seen by the previous call of pg_buffer_strategy()
+ * in this backend
+ */
+typedef struct BctStrategySample {
+	bool		valid;
+	TimestampTz	time;
+	uint32		complete_passes;
+	int			next_victim_buffer;
+	int64		buf_alloc;
+} BctStrategySample;
+
+static BctStrategySample bct_prev_strategy_sample = {0};
+
+/*
+ * Progress of a balanced flush on one tablespace,
+ * the same as CkptTsStatus of BufferSync()
+ */
+typedef struct BctTsFlushStatus {
+	Oid			spcOid;
+	float8		progress;
+	float8		progress_slice;
+	int			num_to_write;
+	int			num_written;
+	int			index;
+} BctTsFlushStatus;
 
 /*-------------------------------------------------------------------------
  * 							Auxiliary functions
@@ -157,6 +392,125 @@ buf_proc_func_name_to_number(const char *bpfname)
 
 	return BCT_INVALID_BPF;
 }
+/*
+ * Lock mode of the relation whose buffers are processed.
+ *
+ * Writing a page does not affect the users of the relation, so the
+ * flush modes run concurrently with queries (the background flusher
+ * relies on it). All other modes keep AccessExclusiveLock.
+ */
+LOCKMODE
+bpf_relation_lock_mode(BufProcFunc buf_proc_func)
+{
+	switch(buf_proc_func)
+	{
+		case BCT_FLUSH:
+		case BCT_FLUSH_BALANCED:
+		case BCT_FLUSH_OLDER_THAN:
+			return AccessShareLock;
+		default:
+			return AccessExclusiveLock;
+	}
+}
+
+/*
+ * Fraction of the cached pages of a relation (if relid is valid)
+ * or of a database that are dirty.
+ *
+ * Buffer headers are not locked: the result is used only as a 
+ * watermark, and a slightly stale value is fine for it.
+ */
+double
+dirty_buffers_fraction(Oid relid, Oid dbOid)
+{
+	Buffer 		i;
+	BufferDesc 	*bufHdr;
+	uint32 		bufState;
+	int64		ncached = 0;
+	int64		ndirty = 0;
+	Oid			spcOid = InvalidOid;
+	Oid			relNumber = InvalidOid;
+
+	if (OidIsValid(relid))
+	{
+		Relation rel = relation_open(relid, AccessShareLock);
+
+		spcOid = BCT_RELATION_SPCOID(rel);
+		dbOid = BCT_RELATION_DBOID(rel);
+		relNumber = BCT_RELATION_RELNUMBER(rel);
+
+		relation_close(rel, AccessShareLock);
+	}
+
+	for (i = 1; i <= NBuffers; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i - 1);
+		bufState = pg_atomic_read_u32(&bufHdr->state);
+
+		if (!(BUFFER_IS_VALID(bufState)))
+			continue;
+
+		if (BCT_BUFTAG_DBOID(bufHdr->tag) != dbOid)
+			continue;
+
+		if (OidIsValid(relid) && 
+			(BCT_BUFTAG_RELNUMBER(bufHdr->tag) != relNumber ||
+			 BCT_BUFTAG_SPCOID(bufHdr->tag) != spcOid))
+			continue;
+
+		ncached++;
+		if (bufState & BM_DIRTY)
+			ndirty++;
+	}
+
+	return (ncached > 0) ? (double) ndirty / ncached : 0.0;
+}
+
+/*
+ * Flush dirty buffers whose page LSN is at or below lsn.
+ * The scope is the relation fork, relation, database or tablespace
+ * if given, otherwise all buffers. Returns the number of written bytes.
+ */
+int64
+pg_flush_buffers_older_than_internals(XLogRecPtr lsn, text *relName, text *forkName,
+									  Oid dbOid, Oid spcOid)
+{
+	NullableDatum	bpf_args[1];
+	int				nscopes = 0;
+
+	nscopes += (relName != NULL) ? 1 : 0;
+	nscopes += OidIsValid(dbOid) ? 1 : 0;
+	nscopes += OidIsValid(spcOid) ? 1 : 0;
+
+	if (nscopes > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("only one of relname, dboid and spcoid can be specified")));
+
+	if (forkName != NULL && relName == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("fork can be specified only with relname")));
+
+	bpf_args[0].value = LSNGetDatum(lsn);
+	bpf_args[0].isnull = false;
+
+	if (relName != NULL && forkName != NULL)
+		relation_fork_buffers_handler(BCT_FLUSH_OLDER_THAN, relName, forkName, bpf_args);
+	else if (relName != NULL)
+		relation_buffers_handler(BCT_FLUSH_OLDER_THAN, relName, bpf_args);
+	else if (OidIsValid(dbOid))
+		database_buffers_handler(BCT_FLUSH_OLDER_THAN, dbOid, bpf_args);
+	else if (OidIsValid(spcOid))
+		tablespace_buffers_handler(BCT_FLUSH_OLDER_THAN, spcOid, bpf_args);
+	else
+		all_valid_buffers_handler(BCT_FLUSH_OLDER_THAN, bpf_args);
+
+	return (int64) bct_sweep.bytes_written;
+}
+
 /*-------------------------------------------------------------------------
  * 								Check functions
  *-------------------------------------------------------------------------
@@ -202,6 +556,8 @@ bpf_func_nargs_check(BufProcFunc buf_proc_func, short nargs)
 		case BCT_MARK_DIRTY:
 		case BCT_FLUSH:
 		case BCT_INVALIDATE:
+		case BCT_FLUSH_BALANCED:
+		case BCT_EVICT:
 			if (nargs != 0)
 				invalid_nargs = true;	
 			break;
@@ -211,6 +567,8 @@ bpf_func_nargs_check(BufProcFunc buf_proc_func, short nargs)
 		case BCT_CHANGE_RELNUMBER:
 		case BCT_CHANGE_FORKNUM:
 		case BCT_CHANGE_BLOCKNUM:
+		case BCT_CHANGE_USAGECOUNT:
+		case BCT_FLUSH_OLDER_THAN:
 			if (nargs != 1)
 				invalid_nargs = true;	
 			break;
@@ -293,42 +651,59 @@ fork_num_correct_check(ForkNumber forkNum)
  */
 
 /*
- * Wrapper function for buffer processiong functions
+ * Wrapper function for buffer processiong functions.
+ * The buffer is pinned and its content lock is held exclusively.
  */
 static void
 BufProcFuncWrapper(BufProcFunc buf_proc_func, Buffer buffer, NullableDatum *bpf_args)
 {
+	uint64 bytes_written = 0;
+
 	switch(buf_proc_func)	
 	{
 		case BCT_MARK_DIRTY:
 			MarkBufferDirty(buffer);
 			break;
 		case BCT_FLUSH:
+		case BCT_FLUSH_BALANCED:
+			/* Nobody can dirty the buffer while we hold its content lock */
+			if (BCT_BUFFER_IS_DIRTY(buffer))
+				bytes_written = BLCKSZ;
+
 			FlushOneBuffer(buffer);
 			break;
 		case BCT_CHANGE_SPCOID:
+		{
 			Oid spcOid = DatumGetObjectId(bpf_args[0].value);
 
 			change_spcoid_buffer(buffer, spcOid);
 			break;
+		}
 		case BCT_CHANGE_DBOID:
+		{
 			Oid dbOid = DatumGetObjectId(bpf_args[0].value);
 
 			change_dboid_buffer(buffer, dbOid);
 			break;
+		}
 		case BCT_CHANGE_RELNUMBER:
+		{
 			Oid relNumber = (Oid) DatumGetObjectId(bpf_args[0].value);
 
 			change_relnumber_buffer(buffer, relNumber);		
 			break;
+		}
 		case BCT_CHANGE_FORKNUM:
+		{
     		ForkNumber  forkNum = (ForkNumber) bpf_args[0].value;
 
 			fork_num_correct_check(forkNum);
 
 			change_forknum_buffer(buffer, forkNum);
 			break;
+		}
 		case BCT_CHANGE_BLOCKNUM:
+		{
 			BlockNumber blockNum;
 
 			int64_to_block_number_convert_check(DatumGetInt64(bpf_args[0].value));
@@ -336,12 +711,60 @@ BufProcFuncWrapper(BufProcFunc buf_proc_func, Buffer buffer, NullableDatum *bpf_
 
 			change_blocknum_buffer(buffer, blockNum);
 			break;
+		}
 		case BCT_INVALIDATE:
-			invalidate_buffer(buffer);
+			if (!invalidate_buffer(buffer))
+			{
+				bct_sweep_buffer_skipped(0);
+				return;
+			}
+			break;
+		case BCT_CHANGE_USAGECOUNT:
+		{
+			int64 usageCount = DatumGetInt64(bpf_args[0].value);
+
+			if (usageCount < 0 || usageCount > BM_MAX_USAGE_COUNT)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("usage count must be between 0 and %d", 
+								BM_MAX_USAGE_COUNT)));
+
+			change_usagecount_buffer(buffer, (uint32) usageCount);
+			break;
+		}
+		case BCT_FLUSH_OLDER_THAN:
+		{
+			XLogRecPtr lsn = DatumGetLSN(bpf_args[0].value);
+
+			/* Pages changed after lsn are left for the checkpoint */
+			if (BCT_BUFFER_IS_DIRTY(buffer) && 
+				PageGetLSN(BufferGetPage(buffer)) <= lsn)
+			{
+				FlushOneBuffer(buffer);
+				bytes_written = BLCKSZ;
+			}
+			break;
+		}
+		case BCT_EVICT:
+			/* Nobody can dirty the buffer while we hold its content lock */
+			if (BCT_BUFFER_IS_DIRTY(buffer))
+			{
+				FlushOneBuffer(buffer);
+				bytes_written = BLCKSZ;
+			}
+
+			/* A buffer pinned by another backend is only written */
+			if (!invalidate_buffer(buffer))
+			{
+				bct_sweep_buffer_skipped(bytes_written);
+				return;
+			}
 			break;
 		default:
 			Assert(false);
 	}
+
+	bct_sweep_buffer_processed(bytes_written);
 }
 
 /*
@@ -472,9 +895,30 @@ change_blocknum_buffer(Buffer buffer, BlockNumber blockNum)
 }
 
 /*
- * Invalidate buffer
+ * Change usage count of buffer.
+ * The clock sweep evicts buffers with zero usage count first.
  */
 static void
+change_usagecount_buffer(Buffer buffer, uint32 usageCount)
+{
+	BufferDesc 	*bufHdr;
+	uint32 		bufState;
+
+	bufHdr = GetBufferDescriptor(buffer - 1);
+
+	bufState = LockBufHdr(bufHdr);
+
+	bufState &= ~BUF_USAGECOUNT_MASK;
+	bufState += usageCount * BUF_USAGECOUNT_ONE;
+
+	UnlockBufHdr(bufHdr, bufState);
+}
+
+/*
+ * Invalidate buffer pinned by this backend. Buffers pinned by other
+ * backends are in use and are left as they are, returns false then.
+ */
+static bool
 invalidate_buffer(Buffer buffer)
 {
 	BufferDesc *bufHdr = GetBufferDescriptor(buffer - 1);
@@ -510,6 +954,13 @@ invalidate_buffer(Buffer buffer)
 	/* Re-lock the buffer header */
 	buf_state = LockBufHdr(bufHdr);
 
+	if (BUF_STATE_GET_REFCOUNT(buf_state) != 1)
+	{
+		UnlockBufHdr(bufHdr, buf_state);
+		LWLockRelease(oldPartitionLock);
+		return false;
+	}
+
 	/*
 	 * Clear out the buffer's tag and flags.  We must do this to ensure that
 	 * linear scans of the buffer array don't think the buffer is valid.
@@ -538,523 +989,2310 @@ invalidate_buffer(Buffer buffer)
 	 * Insert the buffer at the head of the list of free buffers.
 	 */
 	StrategyFreeBuffer(bufHdr);
+
+	return true;
 }
 
 /*-------------------------------------------------------------------------
- * 								Handler functions
+ * 							Bulk flush functions
  *-------------------------------------------------------------------------
  */
 
-/*
- * One buffer handler
- */
-void
-one_buffer_handler(BufProcFunc buf_proc_func, Buffer buffer, 
-				   NullableDatum *bpf_args)
+static void
+flush_queue_init(BctFlushQueue *queue, BufProcFunc buf_proc_func, NullableDatum *bpf_args)
 {
-	buffer_is_correct_check(buffer);
-	buffer_is_not_local_check(buffer);
+	memset(queue, 0, sizeof(BctFlushQueue));
 
-	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
-	BufProcFuncWrapper(buf_proc_func, buffer, bpf_args); 
-	LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+	queue->buf_proc_func = buf_proc_func;
+	queue->max_lsn = InvalidXLogRecPtr;
+
+	if (buf_proc_func == BCT_FLUSH_OLDER_THAN)
+	{
+		queue->has_lsn_bound = true;
+		queue->lsn_bound = DatumGetLSN(bpf_args[0].value);
+	}
 }
 
 /*
- * Relation fork buffers handler
+ * Queue a buffer for a bulk flush if it needs to be written.
+ * Called after the buffer header lock is released.
  */
-void
-relation_fork_buffers_handler(BufProcFunc buf_proc_func, 
-								 text *relName, text *forkName, 
-								 NullableDatum *bpf_args)
+static void
+flush_queue_add(BctFlushQueue *queue, BufferTag *tag, uint32 bufState, 
+				XLogRecPtr lsn, int buf_id)
 {
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
-
-	Relation 	rel;
-	RangeVar 	*relrv;
-	ForkNumber 	forkNum; 
+	BctFlushItem *item;
 
-	/* Open relation */
-	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
-	rel = relation_openrv(relrv, AccessExclusiveLock);
+	if (!(BUFFER_IS_VALID(bufState)) || !(bufState & BM_DIRTY))
+		return;
 
-	other_temp_check(rel);
+	/* a page whose LSN moves under us is being changed and is newer anyway */
+	if (queue->has_lsn_bound && lsn > queue->lsn_bound)
+		return;
 
-	forkNum = forkname_to_number(text_to_cstring(forkName));	
+	/* FlushBuffer() flushes WAL only for permanent relations */
+	if ((bufState & BM_PERMANENT) && lsn > queue->max_lsn)
+		queue->max_lsn = lsn;
 
-	/* Iterate over all non-local buffers */
-	for (i = 1; i <= NBuffers; i++)
+	if (queue->nitems >= queue->maxitems)
 	{
-		bufHdr = GetBufferDescriptor(i - 1);
-		bufState = LockBufHdr(bufHdr);
-
-		if (BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, rel) && 
-			BCT_IS_BUFFER_BELONGS_FORK(bufHdr, forkNum))
-		{
-			LockBuffer(i, BUFFER_LOCK_EXCLUSIVE);
-			UnlockBufHdr(bufHdr, bufState);
-			BufProcFuncWrapper(buf_proc_func, (Buffer) i, bpf_args);
-			LockBuffer(i, BUFFER_LOCK_UNLOCK);			
-		}
+		/* With a large shared_buffers the queue may exceed MaxAllocSize */
+		queue->maxitems = (queue->maxitems == 0) ? 1024 : queue->maxitems * 2;
+		if (queue->items == NULL)
+			queue->items = palloc_extended(queue->maxitems * sizeof(BctFlushItem), 
+										   MCXT_ALLOC_HUGE);
 		else
-		{
-			UnlockBufHdr(bufHdr, bufState);
-		}
+			queue->items = repalloc_huge(queue->items, 
+										 queue->maxitems * sizeof(BctFlushItem));
 	}
 
-	/* Close relation */
-	relation_close(rel, AccessExclusiveLock);
+	item = &queue->items[queue->nitems++];
+	item->tag = *tag;
+	item->buf_id = buf_id;
 }
 
 /*
- * Relation buffers handler
+ * Sort flush items by tablespace, database, relation, fork and block, 
+ * the order of ckpt_buforder_comparator() with the database added
  */
-void
-relation_buffers_handler(BufProcFunc buf_proc_func, 
-							text *relName, NullableDatum *bpf_args)
+static int
+flush_item_comparator(const void *a, const void *b)
 {
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
+	const BufferTag *ta = &((const BctFlushItem *) a)->tag;
+	const BufferTag *tb = &((const BctFlushItem *) b)->tag;
+
+	if (BCT_BUFTAG_SPCOID(*ta) != BCT_BUFTAG_SPCOID(*tb))
+		return (BCT_BUFTAG_SPCOID(*ta) < BCT_BUFTAG_SPCOID(*tb)) ? -1 : 1;
+	if (BCT_BUFTAG_DBOID(*ta) != BCT_BUFTAG_DBOID(*tb))
+		return (BCT_BUFTAG_DBOID(*ta) < BCT_BUFTAG_DBOID(*tb)) ? -1 : 1;
+	if (BCT_BUFTAG_RELNUMBER(*ta) != BCT_BUFTAG_RELNUMBER(*tb))
+		return (BCT_BUFTAG_RELNUMBER(*ta) < BCT_BUFTAG_RELNUMBER(*tb)) ? -1 : 1;
+	if (ta->forkNum != tb->forkNum)
+		return (ta->forkNum < tb->forkNum) ? -1 : 1;
+	if (ta->blockNum != tb->blockNum)
+		return (ta->blockNum < tb->blockNum) ? -1 : 1;
+	return 0;
+}
 
-	Relation rel;
-	RangeVar *relrv;
+/*
+ * The tablespace with the least progress goes first
+ */
+static int
+ts_flush_progress_comparator(Datum a, Datum b, void *arg)
+{
+	BctTsFlushStatus *sa = (BctTsFlushStatus *) DatumGetPointer(a);
+	BctTsFlushStatus *sb = (BctTsFlushStatus *) DatumGetPointer(b);
 
-	/* Open relation */
-	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
-	rel = relation_openrv(relrv, AccessExclusiveLock);
+	if (sa->progress < sb->progress)
+		return 1;
+	else if (sa->progress == sb->progress)
+		return 0;
+	else
+		return -1;
+}
 
-	other_temp_check(rel);
+/*
+ * Write a queued buffer if it still holds the queued dirty page
+ */
+static void
+flush_queue_write_item(BctFlushItem *item, BufProcFunc buf_proc_func, NullableDatum *bpf_args)
+{
+	BufferDesc	*bufHdr = GetBufferDescriptor(item->buf_id);
+	Buffer		buffer = BufferDescriptorGetBuffer(bufHdr);
+	uint32		bufState;
+	bool		still_dirty;
 
-	/* Iterate over all non-local buffers */
-	for (i = 1; i <= NBuffers; i++)
-	{
-		bufHdr = GetBufferDescriptor(i - 1);
-		bufState = LockBufHdr(bufHdr);
+	/* The buffer may have been written or replaced since the scan */
+	bufState = LockBufHdr(bufHdr);
+	still_dirty = BUFFER_IS_VALID(bufState) && (bufState & BM_DIRTY) &&
+		BCT_BUFTAGS_EQUAL(bufHdr->tag, item->tag);
+	UnlockBufHdr(bufHdr, bufState);
 
-		if (BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, rel))
-		{
-			LockBuffer(i, BUFFER_LOCK_EXCLUSIVE);
-			UnlockBufHdr(bufHdr, bufState);
-			BufProcFuncWrapper(buf_proc_func, (Buffer) i, bpf_args);
-			LockBuffer(i, BUFFER_LOCK_UNLOCK);			
-		}
-		else 
-		{
-			UnlockBufHdr(bufHdr, bufState);
-		}
+	if (still_dirty && bct_pin_cached_buffer(buffer, &item->tag))
+	{
+		bct_sweep_lock_buffer(buffer);
+		BufProcFuncWrapper(buf_proc_func, buffer, bpf_args);
+		LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+		ReleaseBuffer(buffer);
 	}
-
-	/* Close relation */
-	relation_close(rel, AccessExclusiveLock);
 }
 
 /*
- * Database buffers handler
+ * Write the sorted queued buffers interleaving tablespaces.
+ *
+ * Like BufferSync(), every tablespace advances by its share of the total
+ * number of writes, so all tablespaces are busy during the whole flush
+ * instead of one at a time in the buffer descriptor order.
  */
-void
-database_buffers_handler(BufProcFunc buf_proc_func, 
-						 Oid dbOid, NullableDatum *bpf_args)
+static void
+flush_queue_write_balanced(BctFlushQueue *queue, NullableDatum *bpf_args)
 {
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
+	BctTsFlushStatus *per_ts_stat = NULL;
+	binaryheap	*ts_heap;
+	int			num_spaces = 0;
+	int			i;
 
-	/* Iterate over all non-local buffers */
-	for (i = 1; i <= NBuffers; i++)
+	/* Sorted items of one tablespace are adjacent */
+	for (i = 0; i < queue->nitems; i++)
 	{
-		bufHdr = GetBufferDescriptor(i - 1);
-		bufState = LockBufHdr(bufHdr);
+		BctTsFlushStatus *s;
 
-		if (BCT_IS_BUFFER_BELONGS_DATABASE(bufHdr, dbOid))
-		{
-			LockBuffer(i, BUFFER_LOCK_EXCLUSIVE);
-			UnlockBufHdr(bufHdr, bufState);
-			BufProcFuncWrapper(buf_proc_func, (Buffer) i, bpf_args);
-			LockBuffer(i, BUFFER_LOCK_UNLOCK);			
-		}
-		else
+		if (num_spaces == 0 || 
+			per_ts_stat[num_spaces - 1].spcOid != BCT_BUFTAG_SPCOID(queue->items[i].tag))
 		{
-			UnlockBufHdr(bufHdr, bufState);
+			if (per_ts_stat == NULL)
+				per_ts_stat = palloc(sizeof(BctTsFlushStatus));
+			else
+				per_ts_stat = repalloc(per_ts_stat, 
+									   sizeof(BctTsFlushStatus) * (num_spaces + 1));
+
+			s = &per_ts_stat[num_spaces++];
+			s->spcOid = BCT_BUFTAG_SPCOID(queue->items[i].tag);
+			s->progress = 0;
+			s->num_to_write = 0;
+			s->num_written = 0;
+			s->index = i;
 		}
+
+		per_ts_stat[num_spaces - 1].num_to_write++;
 	}
-}
 
-/*
- * Tablespace buffers handler
- */
-void
-tablespace_buffers_handler(BufProcFunc buf_proc_func, 
-						   Oid spcOid, NullableDatum *bpf_args)
-{
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
+	ts_heap = binaryheap_allocate(num_spaces, ts_flush_progress_comparator, NULL);
 
-	/* Iterate over all non-local buffers */
-	for (i = 1; i <= NBuffers; i++)
+	for (i = 0; i < num_spaces; i++)
 	{
-		bufHdr = GetBufferDescriptor(i - 1);
-		bufState = LockBufHdr(bufHdr);
+		BctTsFlushStatus *s = &per_ts_stat[i];
 
-		if (BCT_IS_BUFFER_BELONGS_TABLESPACE(bufHdr, spcOid))
-		{
-			LockBuffer(i, BUFFER_LOCK_EXCLUSIVE);
-			UnlockBufHdr(bufHdr, bufState);
-			BufProcFuncWrapper(buf_proc_func, (Buffer) i, bpf_args);
-			LockBuffer(i, BUFFER_LOCK_UNLOCK);			
-		}
-		else
-		{
-			UnlockBufHdr(bufHdr, bufState);
-		}
+		s->progress_slice = (float8) queue->nitems / s->num_to_write;
+
+		binaryheap_add_unordered(ts_heap, PointerGetDatum(s));
 	}
-}
 
-/*
- * All valid buffers handler
- */
-void
-all_valid_buffers_handler(BufProcFunc buf_proc_func, NullableDatum *bpf_args)
-{
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
+	binaryheap_build(ts_heap);
 
-	/* Iterate over all non-local buffers */
-	for (i = 1; i <= NBuffers; i++)
+	while (!binaryheap_empty(ts_heap))
 	{
-		bufHdr = GetBufferDescriptor(i - 1);
-		bufState = LockBufHdr(bufHdr);
+		BctTsFlushStatus *ts_stat = (BctTsFlushStatus *) 
+			DatumGetPointer(binaryheap_first(ts_heap));
 
-		if (BUFFER_IS_VALID(bufState))
-		{
-			LockBuffer(i, BUFFER_LOCK_EXCLUSIVE);
-			UnlockBufHdr(bufHdr, bufState);
-			BufProcFuncWrapper(buf_proc_func, (Buffer) i, bpf_args);
-			LockBuffer(i, BUFFER_LOCK_UNLOCK);			
-		}
+		CHECK_FOR_INTERRUPTS();
+		bct_sweep_throttle();
+
+		flush_queue_write_item(&queue->items[ts_stat->index], 
+							   queue->buf_proc_func, bpf_args);
+
+		ts_stat->progress += ts_stat->progress_slice;
+		ts_stat->num_written++;
+		ts_stat->index++;
+
+		if (ts_stat->num_written >= ts_stat->num_to_write)
+			binaryheap_remove_first(ts_heap);
 		else
-		{
-			UnlockBufHdr(bufHdr, bufState);
-		}
+			binaryheap_replace_first(ts_heap, PointerGetDatum(ts_stat));
 	}
+
+	binaryheap_free(ts_heap);
+	pfree(per_ts_stat);
 }
 
 /*
- * 
+ * Write the queued buffers.
+ *
+ * WAL is flushed once up to the newest page LSN seen by the scan, so the
+ * writes do not wait for a WAL flush each, as FlushBuffer() would otherwise
+ * do for every recently modified page.  FlushBuffer() still flushes WAL up
+ * to the real page LSN, so a stale hint only costs an extra flush.
  */
-void
-change_buffer_by_page_handler(BufProcFunc buf_proc_func, 
-									   text *relName, text *forkName, 
-									   BlockNumber blockNum, NullableDatum *bpf_args)
+static void
+flush_queue_execute(BctFlushQueue *queue, NullableDatum *bpf_args)
 {
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
-	bool 		buffer_found = false;
-
-	Relation 	rel;
-	RangeVar 	*relrv;
-	ForkNumber 	forkNum; 
-
-	/* Open relation */
-	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
-	rel = relation_openrv(relrv, AccessExclusiveLock);
+	int i;
 
-	other_temp_check(rel);
+	if (queue->nitems == 0)
+		return;
 
-	forkNum = forkname_to_number(text_to_cstring(forkName));	
+	/*
+	 * max_lsn is only a hint, never ask for more WAL than was inserted.
+	 * During recovery FlushBuffer() takes care of each page by itself.
+	 */
+	if (!XLogRecPtrIsInvalid(queue->max_lsn) && !RecoveryInProgress())
+		XLogFlush(Min(queue->max_lsn, GetXLogInsertRecPtr()));
 
-	block_num_not_exist_in_relation_check(rel, forkNum, blockNum);
+	qsort(queue->items, queue->nitems, sizeof(BctFlushItem), flush_item_comparator);
 
-	/* Iterate over all non-local buffers */
-	for (i = 1; i <= NBuffers; i++)
+	if (queue->buf_proc_func == BCT_FLUSH_BALANCED)
+		flush_queue_write_balanced(queue, bpf_args);
+	else
 	{
-		bufHdr = GetBufferDescriptor(i - 1);
-		bufState = LockBufHdr(bufHdr);
-		
-		if (BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, rel) && 
-			BCT_IS_BUFFER_BELONGS_FORK(bufHdr, forkNum) &&
-			BCT_IS_BUFFER_BELONGS_BLOCK(bufHdr, blockNum))
+		for (i = 0; i < queue->nitems; i++)
 		{
-			LockBuffer(i, BUFFER_LOCK_EXCLUSIVE);
-			UnlockBufHdr(bufHdr, bufState);
-			BufProcFuncWrapper(buf_proc_func, (Buffer) i, bpf_args);
-			LockBuffer(i, BUFFER_LOCK_UNLOCK);			
+			CHECK_FOR_INTERRUPTS();
+			bct_sweep_throttle();
 
-			buffer_found = true;
-			break;
-		}
-		else
-		{
-			UnlockBufHdr(bufHdr, bufState);
+			flush_queue_write_item(&queue->items[i], queue->buf_proc_func, bpf_args);
 		}
 	}
 
-	if (!buffer_found)
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				errmsg("the block with blockNum %u is not in buffercache",
-						blockNum)));
+	pfree(queue->items);
+	queue->items = NULL;
+	queue->nitems = 0;
+	queue->maxitems = 0;
+}
 
-	/* Close relation */
-	relation_close(rel, AccessExclusiveLock);
+/*-------------------------------------------------------------------------
+ * 								Scan engine
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * Does the buffer belong to the scope of the scan? 
+ * The header lock must be held.
+ *
+ * Always inlined with a constant scope, so every specialization of
+ * bct_scan_buffers_impl() tests only its own predicate.
+ */
+static pg_attribute_always_inline bool
+bct_scan_match(BctScan *scan, BctScope scope, BufferDesc *bufHdr, uint32 bufState)
+{
+	switch (scope)
+	{
+		case BCT_SCOPE_RELATION_FORK:
+			return BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, scan->rel) && 
+				BCT_IS_BUFFER_BELONGS_FORK(bufHdr, scan->forkNum);
+		case BCT_SCOPE_RELATION:
+			return BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, scan->rel);
+		case BCT_SCOPE_DATABASE:
+			return BCT_IS_BUFFER_BELONGS_DATABASE(bufHdr, scan->dbOid);
+		case BCT_SCOPE_TABLESPACE:
+			return BCT_IS_BUFFER_BELONGS_TABLESPACE(bufHdr, scan->spcOid);
+		case BCT_SCOPE_ALL_VALID:
+			return BUFFER_IS_VALID(bufState);
+		case BCT_SCOPE_PAGE:
+			return BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, scan->rel) && 
+				BCT_IS_BUFFER_BELONGS_FORK(bufHdr, scan->forkNum) &&
+				BCT_IS_BUFFER_BELONGS_BLOCK(bufHdr, scan->blockNum);
+		default:
+			Assert(false);
+			return false;
+	}
 }
 
-void
-pg_show_buffer_internals(FunctionCallInfo fcinfo, Buffer buffer)
+/*
+ * The scan loop, specialized by bct_scan_buffers() for a constant scope
+ * and action. Returns false when the end of the scan range is reached.
+ */
+static pg_attribute_always_inline bool
+bct_scan_buffers_impl(BctScan *scan, BctScope scope, 
+					  BctScanAction action, void *arg)
 {
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
+	while (scan->next_buf_id < scan->end_buf_id)
+	{
+		BufferDesc	*bufHdr;
+		uint32		bufState;
 
-	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-	TupleDesc 		tupdesc;
-	Tuplestorestate *tupstore;
-	Datum			values[8];
-	bool 			nulls[8] = {0};
+		/* Safe point: no buffer locks are held here */
+		CHECK_FOR_INTERRUPTS();
+		if (bct_sweep.active)
+			bct_sweep_buffer_scanned();
 
-	MemoryContext per_query_ctx;
-	MemoryContext oldcontext;
+		if (scan->local)
+			bufHdr = GetLocalBufferDescriptor(scan->next_buf_id++);
+		else
+			bufHdr = GetBufferDescriptor(scan->next_buf_id++);
 
-	/*
-	 * Reading local buffer is currently not supperted for pg_show_buffer()
-	 */
-	buffer_is_not_local_check(buffer);
+		/* 
+		 * Skip buffers that can't match without taking the header lock.
+		 * A free buffer has no tag, an invalid one has no page.
+		 */
+		bufState = pg_atomic_read_u32(&bufHdr->state);
+		if (scope == BCT_SCOPE_ALL_VALID ? !(BUFFER_IS_VALID(bufState)) : 
+			!(bufState & BM_TAG_VALID))
+			continue;
+
+		/* State filters of the caller need no header lock either */
+		if ((bufState & scan->state_mask) != scan->state_match ||
+			BUF_STATE_GET_USAGECOUNT(bufState) < scan->min_usagecount)
+			continue;
+
+		/* Local buffers are changed only by this backend */
+		if (!scan->local)
+			bufState = LockBufHdr(bufHdr);
 
-	buffer_is_correct_check(buffer);
+		if (!bct_scan_match(scan, scope, bufHdr, bufState))
+		{
+			if (!scan->local)
+				UnlockBufHdr(bufHdr, bufState);
+			continue;
+		}
 
-	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+		if (!action(bufHdr, bufState, arg))
+			return true;
 
-	/* get the requested return tuple description */
-	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+		/* A page is cached in one buffer at most */
+		if (scope == BCT_SCOPE_PAGE)
+		{
+			scan->next_buf_id = scan->end_buf_id;
+			return false;
+		}
+	}
 
-	/* let the caller know we're sending back a tuplestore */
-	rsinfo->returnMode = SFRM_Materialize;
+	return false;
+}
 
-	tupstore = tuplestore_begin_heap(true, false, work_mem);
+#define BCT_SCAN_SPECIALIZE(_bct_scope_) \
+	case _bct_scope_: \
+		if (action == bct_scan_action_process) \
+			return bct_scan_buffers_impl(scan, _bct_scope_, \
+										 bct_scan_action_process, arg); \
+		if (action == bct_scan_action_queue_flush) \
+			return bct_scan_buffers_impl(scan, _bct_scope_, \
+										 bct_scan_action_queue_flush, arg); \
+		return bct_scan_buffers_impl(scan, _bct_scope_, action, arg)
 
-	bufHdr = GetBufferDescriptor(buffer - 1);
-	bufState = LockBufHdr(bufHdr);
+/*
+ * Prepare a scan over all shared buffers, or all local buffers
+ * of the backend
+ */
+static void
+bct_scan_init(BctScan *scan, BctScope scope, bool local)
+{
+	memset(scan, 0, sizeof(BctScan));
 
-	if (BUFFER_IS_VALID(bufState))
-	{
-		values[0] = (Datum) bufHdr->tag.blockNum;
-		values[1] = CStringGetTextDatum(forkNames[bufHdr->tag.forkNum]);	
-#ifdef HAVE_RELFILENUMBERMAP_H
-		values[2] = (Datum) bufHdr->tag.rnode.relNode;
-		values[3] = (Datum) bufHdr->tag.rnode.dbNode;
-		values[4] = (Datum) bufHdr->tag.rnode.spcNode;
-#else
-		values[2] = (Datum) bufHdr->tag.relNumber;
-		values[3] = (Datum) bufHdr->tag.dbOid;
-		values[4] = (Datum) bufHdr->tag.spcOid;
-#endif  /* HAVE_RELFILENUMBERMAP_H */
-		values[5] = BoolGetDatum((bool) (bufState & BM_DIRTY));
-		values[6] = (Datum) BUF_STATE_GET_USAGECOUNT(bufState); 
-		values[7] = (Datum) BUF_STATE_GET_REFCOUNT(bufState);
-	}
-	else
+	scan->scope = scope;
+	scan->local = local;
+	scan->next_buf_id = 0;
+	scan->end_buf_id = local ? NLocBuffer : NBuffers;
+}
+
+/*
+ * Call the action for every buffer of the scope, starting from the scan
+ * position. The action is called with the buffer header locked and must
+ * unlock it. If the action returns false, the scan stops and returns
+ * true; it can be continued by the next call.
+ *
+ * The scan loop is specialized for every scope and for the buffer
+ * processing actions, so neither the predicate nor the action is
+ * chosen per buffer.
+ */
+static bool
+bct_scan_buffers(BctScan *scan, BctScanAction action, void *arg)
+{
+	switch (scan->scope)
 	{
-		nulls[0] = true;
-		nulls[1] = true;
-		nulls[2] = true;
-		nulls[3] = true;
-		nulls[4] = true;
-		nulls[5] = true;
-		nulls[6] = true;
-		nulls[7] = true;
+		BCT_SCAN_SPECIALIZE(BCT_SCOPE_RELATION_FORK);
+		BCT_SCAN_SPECIALIZE(BCT_SCOPE_RELATION);
+		BCT_SCAN_SPECIALIZE(BCT_SCOPE_DATABASE);
+		BCT_SCAN_SPECIALIZE(BCT_SCOPE_TABLESPACE);
+		BCT_SCAN_SPECIALIZE(BCT_SCOPE_ALL_VALID);
+		BCT_SCAN_SPECIALIZE(BCT_SCOPE_PAGE);
+		default:
+			elog(ERROR, "unsupported buffer scan scope: %d", scan->scope);
 	}
 
-	UnlockBufHdr(bufHdr, bufState);
+	return false;
+}
 
-	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-			elog(ERROR, "return type must be a row type");
-	
-	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+/*
+ * Scan action: apply the buffer processing function to the pinned buffer
+ * under its content lock
+ */
+static bool
+bct_scan_action_process(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctScanProcessArgs	*args = (BctScanProcessArgs *) arg;
+	Buffer				buffer = BufferDescriptorGetBuffer(bufHdr);
+	BufferTag			tag = bufHdr->tag;
 
+	UnlockBufHdr(bufHdr, bufState);
 
-	/*
-	 * no longer need the tuple descriptor reference created by
-	 * TupleDescGetAttInMetadata()
-	 */
-	buffer_is_not_local_check(buffer);
+	/* The page may have been evicted since the header was unlocked */
+	if (!bct_pin_cached_buffer(buffer, &tag))
+		return true;
 
-	buffer_is_correct_check(buffer);
+	bct_sweep_lock_buffer(buffer);
+	BufProcFuncWrapper(args->buf_proc_func, buffer, args->bpf_args);
+	LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+	ReleaseBuffer(buffer);
 
-	ReleaseTupleDesc(tupdesc);
+	args->nprocessed++;
 
-	tuplestore_donestoring(tupstore);
-	rsinfo->setResult = tupstore;
+	return true;
+}
 
-	/*
-	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
-	 * tuples are in our tuplestore and passed back through rsinfo->setResult.
-	 * rsinfo->setDesc is set to the tuple description that we actually used
-	 * to build our tuples with, so the caller can verify we did what it was
-	 * expecting.
-	 */
-	rsinfo->setDesc = tupdesc;
+/*
+ * Scan action: queue the buffer for a bulk flush
+ */
+static bool
+bct_scan_action_queue_flush(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctFlushQueue	*queue = (BctFlushQueue *) arg;
+	BufferTag		tag = bufHdr->tag;
+	XLogRecPtr		lsn = BCT_BUFFER_PAGE_LSN(bufHdr);
 
-	MemoryContextSwitchTo(oldcontext);
+	UnlockBufHdr(bufHdr, bufState);
+	flush_queue_add(queue, &tag, bufState, lsn, bufHdr->buf_id);
+
+	return true;
 }
 
 /*
- * Show buffers from the buffer cache that belong to 
- * a specific relation  
+ * Apply the buffer processing function to all buffers of the scan.
+ * Flushes are queued during the scan and written after it.
+ * Returns the number of processed buffers, flushes are not counted.
  */
-void
-pg_show_relation_buffers_internals(FunctionCallInfo fcinfo, text *relname)
+static int64
+bct_scan_process(BctScan *scan, BufProcFunc buf_proc_func, NullableDatum *bpf_args)
 {
-	Buffer 		i;
-	BufferDesc 	*bufHdr;
-	uint32 		bufState;
+	BctScanProcessArgs	args;
 
-	Relation rel;
-	RangeVar *relrv;
+	if (scan->local)
+		return bct_scan_process_local(scan, buf_proc_func);
 
-	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-	TupleDesc 		tupdesc;
-	Tuplestorestate *tupstore;
-	Datum			values[6];
-	bool 			nulls[6] = {0};
+	if (BCT_BPF_IS_BULK_FLUSH(buf_proc_func))
+	{
+		BctFlushQueue	flush_queue;
 
-	MemoryContext per_query_ctx;
-	MemoryContext oldcontext;
+		flush_queue_init(&flush_queue, buf_proc_func, bpf_args);
+		bct_scan_buffers(scan, bct_scan_action_queue_flush, &flush_queue);
+		flush_queue_execute(&flush_queue, bpf_args);
 
-	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+		return 0;
+	}
 
-	/* get the requested return tuple description */
-	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+	args.buf_proc_func = buf_proc_func;
+	args.bpf_args = bpf_args;
+	args.nprocessed = 0;
 
-	/* let the caller know we're sending back a tuplestore */
-	rsinfo->returnMode = SFRM_Materialize;
+	bct_scan_buffers(scan, bct_scan_action_process, &args);
 
-	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	return args.nprocessed;
+}
 
-	/* Open relation */
-	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relname));	
-	rel = relation_openrv(relrv, AccessExclusiveLock);
+/*
+ * Scan action: write a dirty local buffer, the same way 
+ * FlushRelationBuffers() does for temporary relations
+ */
+static bool
+bct_scan_action_local(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctScanLocalArgs	*args = (BctScanLocalArgs *) arg;
+	BufferTag			tag = bufHdr->tag;
+	uint64				bytes_written = 0;
 
-	other_temp_check(rel);
+	if (!(BUFFER_IS_VALID(bufState)))
+		return true;
 
-	if (RelationUsesLocalBuffers(rel))
+	if (args->buf_proc_func != BCT_INVALIDATE && (bufState & BM_DIRTY))
 	{
-		/* 
-		 *Iterate over all local buffers 
-		 */
-		for (i = 0; i < NLocBuffer; i++)
-		{
-			bufHdr = GetLocalBufferDescriptor(i);
-			bufState = LockBufHdr(bufHdr);
-
-			if (BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, rel))
-			{
-				values[0] = (Datum) BufferDescriptorGetBuffer(bufHdr);
-				values[1] = (Datum) bufHdr->tag.blockNum;
-				values[2] = BoolGetDatum((bool) (bufState & BM_DIRTY));
-				values[3] = (Datum) BUF_STATE_GET_USAGECOUNT(bufState); 
-				values[4] = (Datum) BUF_STATE_GET_REFCOUNT(bufState);
-				values[5] = CStringGetTextDatum(forkNames[bufHdr->tag.forkNum]);	
-
-				if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-					elog(ERROR, "return type must be a row type");
-				
-				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
-			}
+		Page	page = BufferGetPage(BufferDescriptorGetBuffer(bufHdr));
 
-			UnlockBufHdr(bufHdr, bufState);
-		}
-	}
-	else
-	{
-		/* 
-		 * Iterate over all non-local buffers 
-		 */
-		for (i = 0; i < NBuffers; i++)
-		{
-			bufHdr = GetBufferDescriptor(i);
-			bufState = LockBufHdr(bufHdr);
+		PageSetChecksumInplace(page, tag.blockNum);
+		smgrwrite(args->smgr, tag.forkNum, tag.blockNum, page, false);
 
-			if (BCT_IS_BUFFER_BELONGS_RELATION(bufHdr, rel))
-			{
-				values[0] = (Datum) BufferDescriptorGetBuffer(bufHdr);
-				values[1] = (Datum) bufHdr->tag.blockNum;
-				values[2] = BoolGetDatum((bool) (bufState & BM_DIRTY));
-				values[3] = (Datum) BUF_STATE_GET_USAGECOUNT(bufState); 
-				values[4] = (Datum) BUF_STATE_GET_REFCOUNT(bufState);
-				values[5] = CStringGetTextDatum(forkNames[bufHdr->tag.forkNum]);	
-
-				if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-						elog(ERROR, "return type must be a row type");
-				
-				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
-			}
+		/* Local buffers are changed only by this backend */
+		bufState = pg_atomic_read_u32(&bufHdr->state);
+		bufState &= ~(BM_DIRTY | BM_JUST_DIRTIED);
+		pg_atomic_unlocked_write_u32(&bufHdr->state, bufState);
 
-			UnlockBufHdr(bufHdr, bufState);
-		}
+		pgBufferUsage.local_blks_written++;
+		bytes_written = BLCKSZ;
 	}
 
-	/*
-	 * no longer need the tuple descriptor reference created by
-	 * TupleDescGetAttInMetadata()
-	 */
-	ReleaseTupleDesc(tupdesc);
+	args->nprocessed++;
+	bct_sweep_buffer_processed(bytes_written);
 
-	tuplestore_donestoring(tupstore);
-	rsinfo->setResult = tupstore;
+	return true;
+}
 
-	/*
-	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
-	 * tuples are in our tuplestore and passed back through rsinfo->setResult.
-	 * rsinfo->setDesc is set to the tuple description that we actually used
+/*
+ * Apply the buffer processing function to the local buffers of 
+ * a temporary relation of this backend.
+ *
+ * Local buffers have no content locks and are not in the shared buffer
+ * mapping table, so only writing and dropping them is supported. Pages
+ * are dropped with DropRelationBuffers(), which fails if a page is still 
+ * pinned by a query of this backend.
+ */
+static int64
+bct_scan_process_local(BctScan *scan, BufProcFunc buf_proc_func)
+{
+	BctScanLocalArgs	args;
+	ForkNumber			forks[MAX_FORKNUM + 1];
+	BlockNumber			firstDelBlocks[MAX_FORKNUM + 1];
+	int					nforks = 0;
+	ForkNumber			forkNum;
+
+	switch (buf_proc_func)
+	{
+		case BCT_FLUSH:
+		case BCT_FLUSH_BALANCED:
+		case BCT_INVALIDATE:
+		case BCT_EVICT:
+			break;
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("mode \"%s\" is not supported for temporary relations",
+						   bufProcFuncNames[buf_proc_func]),
+					errhint("Use flush, invalidate or evict.")));
+	}
+
+	args.buf_proc_func = buf_proc_func;
+	args.smgr = RelationGetSmgr(scan->rel);
+	args.nprocessed = 0;
+
+	bct_scan_buffers(scan, bct_scan_action_local, &args);
+
+	if (buf_proc_func == BCT_FLUSH || buf_proc_func == BCT_FLUSH_BALANCED)
+		return args.nprocessed;
+
+	for (forkNum = 0; forkNum <= MAX_FORKNUM; forkNum++)
+	{
+		if (scan->scope == BCT_SCOPE_RELATION_FORK && forkNum != scan->forkNum)
+			continue;
+
+		forks[nforks] = forkNum;
+		firstDelBlocks[nforks] = 0;
+		nforks++;
+	}
+
+#ifdef PG_VERSION_NUM_EQUAL_OR_MORE_160000
+	DropRelationBuffers(args.smgr, forks, nforks, firstDelBlocks);
+#else
+	DropRelFileNodeBuffers(args.smgr, forks, nforks, firstDelBlocks);
+#endif	/* PG_VERSION_NUM >= 160000*/
+
+	return args.nprocessed;
+}
+
+/*-------------------------------------------------------------------------
+ * 								Handler functions
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * One buffer handler, a buffer without a valid page is left as it is
+ */
+void
+one_buffer_handler(BufProcFunc buf_proc_func, Buffer buffer, 
+				   NullableDatum *bpf_args)
+{
+	BufferDesc	*bufHdr;
+	BufferTag	tag;
+	uint32		bufState;
+
+	buffer_is_correct_check(buffer);
+	buffer_is_not_local_check(buffer);
+
+	bct_sweep_begin(BCT_SCOPE_BUFFER, buf_proc_func);
+
+	bufHdr = GetBufferDescriptor(buffer - 1);
+	bufState = LockBufHdr(bufHdr);
+	tag = bufHdr->tag;
+	UnlockBufHdr(bufHdr, bufState);
+
+	if (BUFFER_IS_VALID(bufState) && bct_pin_cached_buffer(buffer, &tag))
+	{
+		bct_sweep_lock_buffer(buffer);
+		BufProcFuncWrapper(buf_proc_func, buffer, bpf_args); 
+		LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+		ReleaseBuffer(buffer);
+	}
+
+	bct_sweep_buffer_scanned();
+	bct_sweep_end();
+}
+
+/*
+ * Relation fork buffers handler
+ */
+void
+relation_fork_buffers_handler(BufProcFunc buf_proc_func, 
+								 text *relName, text *forkName, 
+								 NullableDatum *bpf_args)
+{
+	BctScan		scan;
+	Relation 	rel;
+	RangeVar 	*relrv;
+	LOCKMODE	lockmode = bpf_relation_lock_mode(buf_proc_func);
+
+	/* Open relation */
+	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
+	rel = relation_openrv(relrv, lockmode);
+
+	other_temp_check(rel);
+
+	/* Temporary relations of this backend are in the local buffers */
+	bct_scan_init(&scan, BCT_SCOPE_RELATION_FORK, RelationUsesLocalBuffers(rel));
+	scan.rel = rel;
+	scan.forkNum = forkname_to_number(text_to_cstring(forkName));	
+
+	bct_sweep_begin(BCT_SCOPE_RELATION_FORK, buf_proc_func);
+	bct_scan_process(&scan, buf_proc_func, bpf_args);
+	bct_sweep_end();
+
+	/* Close relation */
+	relation_close(rel, lockmode);
+}
+
+/*
+ * Relation buffers handler
+ */
+void
+relation_buffers_handler(BufProcFunc buf_proc_func, 
+							text *relName, NullableDatum *bpf_args)
+{
+	BctScan		scan;
+	Relation 	rel;
+	RangeVar 	*relrv;
+	LOCKMODE	lockmode = bpf_relation_lock_mode(buf_proc_func);
+
+	/* Open relation */
+	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
+	rel = relation_openrv(relrv, lockmode);
+
+	other_temp_check(rel);
+
+	/* Temporary relations of this backend are in the local buffers */
+	bct_scan_init(&scan, BCT_SCOPE_RELATION, RelationUsesLocalBuffers(rel));
+	scan.rel = rel;
+
+	bct_sweep_begin(BCT_SCOPE_RELATION, buf_proc_func);
+	bct_scan_process(&scan, buf_proc_func, bpf_args);
+	bct_sweep_end();
+
+	/* Close relation */
+	relation_close(rel, lockmode);
+}
+
+/*
+ * Database buffers handler
+ */
+void
+database_buffers_handler(BufProcFunc buf_proc_func, 
+						 Oid dbOid, NullableDatum *bpf_args)
+{
+	BctScan		scan;
+
+	bct_scan_init(&scan, BCT_SCOPE_DATABASE, false);
+	scan.dbOid = dbOid;
+
+	bct_sweep_begin(BCT_SCOPE_DATABASE, buf_proc_func);
+	bct_scan_process(&scan, buf_proc_func, bpf_args);
+	bct_sweep_end();
+}
+
+/*
+ * Tablespace buffers handler
+ */
+void
+tablespace_buffers_handler(BufProcFunc buf_proc_func, 
+						   Oid spcOid, NullableDatum *bpf_args)
+{
+	BctScan		scan;
+
+	bct_scan_init(&scan, BCT_SCOPE_TABLESPACE, false);
+	scan.spcOid = spcOid;
+
+	bct_sweep_begin(BCT_SCOPE_TABLESPACE, buf_proc_func);
+	bct_scan_process(&scan, buf_proc_func, bpf_args);
+	bct_sweep_end();
+}
+
+/*
+ * All valid buffers handler
+ */
+void
+all_valid_buffers_handler(BufProcFunc buf_proc_func, NullableDatum *bpf_args)
+{
+	BctScan		scan;
+
+	bct_scan_init(&scan, BCT_SCOPE_ALL_VALID, false);
+
+	bct_sweep_begin(BCT_SCOPE_ALL_VALID, buf_proc_func);
+	bct_scan_process(&scan, buf_proc_func, bpf_args);
+	bct_sweep_end();
+}
+
+/*
+ * Buffer of a relation page handler
+ */
+void
+change_buffer_by_page_handler(BufProcFunc buf_proc_func, 
+									   text *relName, text *forkName, 
+									   BlockNumber blockNum, NullableDatum *bpf_args)
+{
+	BctScan		scan;
+	BctScanProcessArgs	args;
+
+	Relation 	rel;
+	RangeVar 	*relrv;
+	LOCKMODE	lockmode = bpf_relation_lock_mode(buf_proc_func);
+
+	/* Open relation */
+	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
+	rel = relation_openrv(relrv, lockmode);
+
+	other_temp_check(rel);
+
+	/* Local buffers can only be written or dropped fork by fork */
+	if (RelationUsesLocalBuffers(rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("this function only works with non-local buffers"),
+				errhint("Use pg_change_relation_fork_buffers() or pg_change_relation_buffers() for temporary relations.")));
+
+	bct_scan_init(&scan, BCT_SCOPE_PAGE, false);
+	scan.rel = rel;
+	scan.forkNum = forkname_to_number(text_to_cstring(forkName));	
+	scan.blockNum = blockNum;
+
+	block_num_not_exist_in_relation_check(rel, scan.forkNum, blockNum);
+
+	args.buf_proc_func = buf_proc_func;
+	args.bpf_args = bpf_args;
+	args.nprocessed = 0;
+
+	bct_sweep_begin(BCT_SCOPE_PAGE, buf_proc_func);
+	bct_scan_buffers(&scan, bct_scan_action_process, &args);
+	bct_sweep_end();
+
+	if (args.nprocessed == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("the block with blockNum %u is not in buffercache",
+						blockNum)));
+
+	/* Close relation */
+	relation_close(rel, lockmode);
+}
+
+void
+pg_show_buffer_internals(FunctionCallInfo fcinfo, Buffer buffer)
+{
+	BufferDesc 	*bufHdr;
+	uint32 		bufState;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+	Datum			values[8];
+	bool 			nulls[8] = {0};
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	/*
+	 * Reading local buffer is currently not supperted for pg_show_buffer()
+	 */
+	buffer_is_not_local_check(buffer);
+
+	buffer_is_correct_check(buffer);
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	bufHdr = GetBufferDescriptor(buffer - 1);
+	bufState = LockBufHdr(bufHdr);
+
+	if (BUFFER_IS_VALID(bufState))
+	{
+		values[0] = (Datum) bufHdr->tag.blockNum;
+		values[1] = CStringGetTextDatum(forkNames[bufHdr->tag.forkNum]);	
+#ifdef HAVE_RELFILENUMBERMAP_H
+		values[2] = (Datum) bufHdr->tag.rnode.relNode;
+		values[3] = (Datum) bufHdr->tag.rnode.dbNode;
+		values[4] = (Datum) bufHdr->tag.rnode.spcNode;
+#else
+		values[2] = (Datum) bufHdr->tag.relNumber;
+		values[3] = (Datum) bufHdr->tag.dbOid;
+		values[4] = (Datum) bufHdr->tag.spcOid;
+#endif  /* HAVE_RELFILENUMBERMAP_H */
+		values[5] = BoolGetDatum((bool) (bufState & BM_DIRTY));
+		values[6] = (Datum) BUF_STATE_GET_USAGECOUNT(bufState); 
+		values[7] = (Datum) BUF_STATE_GET_REFCOUNT(bufState);
+	}
+	else
+	{
+		nulls[0] = true;
+		nulls[1] = true;
+		nulls[2] = true;
+		nulls[3] = true;
+		nulls[4] = true;
+		nulls[5] = true;
+		nulls[6] = true;
+		nulls[7] = true;
+	}
+
+	UnlockBufHdr(bufHdr, bufState);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+	
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	buffer_is_not_local_check(buffer);
+
+	buffer_is_correct_check(buffer);
+
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through rsinfo->setResult.
+	 * rsinfo->setDesc is set to the tuple description that we actually used
 	 * to build our tuples with, so the caller can verify we did what it was
 	 * expecting.
 	 */
 	rsinfo->setDesc = tupdesc;
 
-	MemoryContextSwitchTo(oldcontext);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Scan action of pg_show_relation_buffers()
+ */
+static bool
+show_relation_buffers_action(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctScanOutput	*output = (BctScanOutput *) arg;
+	Datum			values[6];
+	bool 			nulls[6] = {0};
+	BufferTag		tag = bufHdr->tag;
+
+	BCT_UNLOCK_BUF_HDR(bufHdr, bufState);
+
+	values[0] = (Datum) BufferDescriptorGetBuffer(bufHdr);
+	values[1] = (Datum) tag.blockNum;
+	values[2] = BoolGetDatum((bool) (bufState & BM_DIRTY));
+	values[3] = (Datum) BUF_STATE_GET_USAGECOUNT(bufState); 
+	values[4] = (Datum) BUF_STATE_GET_REFCOUNT(bufState);
+	values[5] = CStringGetTextDatum(forkNames[tag.forkNum]);	
+
+	tuplestore_putvalues(output->tupstore, output->tupdesc, values, nulls);
+
+	return true;
+}
+
+/*
+ * Show buffers from the buffer cache that belong to 
+ * a specific relation  
+ */
+void
+pg_show_relation_buffers_internals(FunctionCallInfo fcinfo, text *relname)
+{
+	BctScan		scan;
+	BctScanOutput	output;
+
+	Relation rel;
+	RangeVar *relrv;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* get the requested return tuple description */
+	tupdesc = CreateTupleDescCopy(rsinfo->expectedDesc);
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	/* Open relation */
+	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relname));	
+	rel = relation_openrv(relrv, AccessExclusiveLock);
+
+	other_temp_check(rel);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	output.tupstore = tupstore;
+	output.tupdesc = tupdesc;
+
+	/* Temporary relations are in the local buffers */
+	bct_scan_init(&scan, BCT_SCOPE_RELATION, RelationUsesLocalBuffers(rel));
+	scan.rel = rel;
+
+	bct_scan_buffers(&scan, show_relation_buffers_action, &output);
+
+	/*
+	 * no longer need the tuple descriptor reference created by
+	 * TupleDescGetAttInMetadata()
+	 */
+	ReleaseTupleDesc(tupdesc);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+
+	/*
+	 * SFRM_Materialize mode expects us to return a NULL Datum. The actual
+	 * tuples are in our tuplestore and passed back through rsinfo->setResult.
+	 * rsinfo->setDesc is set to the tuple description that we actually used
+	 * to build our tuples with, so the caller can verify we did what it was
+	 * expecting.
+	 */
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Close relation*/
+	relation_close(rel, AccessExclusiveLock);
+}
+
+/*
+ * Scan action of pg_show_buffers(), stops the scan 
+ * at the first buffer passing the filters
+ */
+static bool
+show_buffers_action(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctShowBuffersState	*state = (BctShowBuffersState *) arg;
+	BufferTag			tag = bufHdr->tag;
+
+	UnlockBufHdr(bufHdr, bufState);
+
+	if ((state->filter_dboid && BCT_BUFTAG_DBOID(tag) != state->dbOid) ||
+		(state->filter_spcoid && BCT_BUFTAG_SPCOID(tag) != state->spcOid) ||
+		(state->filter_relnumber && BCT_BUFTAG_RELNUMBER(tag) != state->relNumber) ||
+		(state->filter_fork && tag.forkNum != state->forkNum))
+		return true;
+
+	state->buffer = BufferDescriptorGetBuffer(bufHdr);
+	state->tag = tag;
+	state->bufState = bufState;
+
+	return false;
+}
+
+/*
+ * Show buffers matching the filters, one row per call.
+ *
+ * Unlike pg_show_relation_buffers() nothing is materialized: the scan
+ * position is kept between calls, so the first row is returned as soon
+ * as it is found and LIMIT stops the scan.
+ */
+Datum
+pg_show_buffers_internals(FunctionCallInfo fcinfo)
+{
+	FuncCallContext		*funcctx;
+	BctShowBuffersState	*state;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext	oldcontext;
+		TupleDesc		tupdesc;
+
+		superuser_check();
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		state = palloc0(sizeof(BctShowBuffersState));
+
+		bct_scan_init(&state->scan, BCT_SCOPE_ALL_VALID, false);
+		if ((state->filter_dboid = !PG_ARGISNULL(0)))
+			state->dbOid = PG_GETARG_OID(0);
+		if ((state->filter_spcoid = !PG_ARGISNULL(1)))
+			state->spcOid = PG_GETARG_OID(1);
+		if ((state->filter_relnumber = !PG_ARGISNULL(2)))
+			state->relNumber = PG_GETARG_OID(2);
+		if ((state->filter_fork = !PG_ARGISNULL(3)))
+			state->forkNum = forkname_to_number(text_to_cstring(PG_GETARG_TEXT_PP(3)));
+
+		/* The state filters are checked by the scan before the header lock */
+		if (!PG_ARGISNULL(4))
+		{
+			state->scan.state_mask = BM_DIRTY;
+			state->scan.state_match = PG_GETARG_BOOL(4) ? BM_DIRTY : 0;
+		}
+		if (!PG_ARGISNULL(5))
+			state->scan.min_usagecount = (uint32) Max(PG_GETARG_INT16(5), 0);
+
+		funcctx->user_fctx = state;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (BctShowBuffersState *) funcctx->user_fctx;
+
+	if (bct_scan_buffers(&state->scan, show_buffers_action, state))
+	{
+		Datum		values[PG_SHOW_BUFFERS_COLS];
+		bool		nulls[PG_SHOW_BUFFERS_COLS] = {0};
+		BufferTag	tag = state->tag;
+		uint32		bufState = state->bufState;
+		HeapTuple	tuple;
+
+		values[0] = Int32GetDatum(state->buffer);
+		values[1] = Int64GetDatum((int64) tag.blockNum);
+		values[2] = CStringGetTextDatum(forkNames[tag.forkNum]);
+		values[3] = ObjectIdGetDatum(BCT_BUFTAG_RELNUMBER(tag));
+		values[4] = ObjectIdGetDatum(BCT_BUFTAG_DBOID(tag));
+		values[5] = ObjectIdGetDatum(BCT_BUFTAG_SPCOID(tag));
+		values[6] = BoolGetDatum((bufState & BM_DIRTY) != 0);
+		values[7] = Int16GetDatum(BUF_STATE_GET_USAGECOUNT(bufState));
+		values[8] = Int32GetDatum(BUF_STATE_GET_REFCOUNT(bufState));
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * Clock sweep position, freelist length and usage count histogram.
+ *
+ * The sweep rate is the number of buffers the clock hand passed since
+ * the previous call in this backend, per second.
+ */
+Datum
+pg_buffer_strategy_internals(FunctionCallInfo fcinfo)
+{
+	BctStrategySample	cur;
+	BctStrategySample	*prev = &bct_prev_strategy_sample;
+	int64		usagecounts[BM_MAX_USAGE_COUNT + 1] = {0};
+	Datum		elems[BM_MAX_USAGE_COUNT + 1];
+	int64		freelist_buffers = 0;
+	int64		unused_buffers = 0;
+	int64		pinned_buffers = 0;
+	int64		dirty_buffers = 0;
+	int			i;
+
+	TupleDesc	tupdesc;
+	Datum		values[PG_BUFFER_STRATEGY_COLS];
+	bool 		nulls[PG_BUFFER_STRATEGY_COLS] = {0};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/*
+	 * numBufferAllocs is not requested: StrategySyncStart() resets it, 
+	 * and the bgwriter paces its writes by it. Allocations are taken
+	 * from the cumulative statistics instead.
+	 */
+	cur.time = GetCurrentTimestamp();
+	cur.next_victim_buffer = StrategySyncStart(&cur.complete_passes, NULL);
+#if (PG_VERSION_NUM >= 150000)
+	cur.buf_alloc = pgstat_fetch_stat_bgwriter()->buf_alloc;
+#else
+	cur.buf_alloc = pgstat_fetch_global()->buf_alloc;
+#endif	/* PG_VERSION_NUM >= 150000 */
+	cur.valid = true;
+
+	/* Without the header locks: the states are a moment's picture anyway */
+	for (i = 0; i < NBuffers; i++)
+	{
+		BufferDesc	*bufHdr = GetBufferDescriptor(i);
+		uint32		bufState = pg_atomic_read_u32(&bufHdr->state);
+
+		if ((i & 0xFFFF) == 0)
+			CHECK_FOR_INTERRUPTS();
+
+#ifdef FREENEXT_NOT_IN_LIST
+		if (bufHdr->freeNext != FREENEXT_NOT_IN_LIST)
+			freelist_buffers++;
+#endif
+
+		if (!(BUFFER_IS_VALID(bufState)))
+		{
+			unused_buffers++;
+			continue;
+		}
+
+		usagecounts[BUF_STATE_GET_USAGECOUNT(bufState)]++;
+		if (BUF_STATE_GET_REFCOUNT(bufState) > 0)
+			pinned_buffers++;
+		if (bufState & BM_DIRTY)
+			dirty_buffers++;
+	}
+
+	for (i = 0; i <= BM_MAX_USAGE_COUNT; i++)
+		elems[i] = Int64GetDatum(usagecounts[i]);
+
+	values[0] = Int32GetDatum(cur.next_victim_buffer + 1);
+	values[1] = Int64GetDatum((int64) cur.complete_passes);
+	values[2] = Int64GetDatum(cur.buf_alloc);
+	values[3] = Int64GetDatum(freelist_buffers);
+#ifndef FREENEXT_NOT_IN_LIST
+	nulls[3] = true;
+#endif
+
+	if (prev->valid && cur.time > prev->time)
+	{
+		float8	secs = (float8) (cur.time - prev->time) / USECS_PER_SEC;
+		float8	passed;
+
+		/* complete_passes is a wrapping counter */
+		passed = (float8) (uint32) (cur.complete_passes - prev->complete_passes) * NBuffers +
+				 cur.next_victim_buffer - prev->next_victim_buffer;
+
+		values[4] = Float8GetDatum(passed / secs);
+		values[5] = Float8GetDatum((float8) (cur.buf_alloc - prev->buf_alloc) / secs);
+		if (passed > 0)
+			values[6] = Float8GetDatum(NBuffers * secs / passed);
+		else
+			nulls[6] = true;
+	}
+	else
+		nulls[4] = nulls[5] = nulls[6] = true;
+
+	values[7] = PointerGetDatum(construct_array(elems, BM_MAX_USAGE_COUNT + 1, INT8OID,
+												sizeof(int64), FLOAT8PASSBYVAL, 
+												TYPALIGN_DOUBLE));
+	values[8] = Int64GetDatum(unused_buffers);
+	values[9] = Int64GetDatum(pinned_buffers);
+	values[10] = Int64GetDatum(dirty_buffers);
+
+	*prev = cur;
+
+	return HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls));
+}
+
+/*
+ * Pin a shared buffer if it still contains the page of the tag.
+ * Never reads from disk: returns false if the page was evicted.
+ *
+ * The pin is not a use of the page: the usage count PinBuffer() adds
+ * is taken back, so that sweeps over the cache do not make every page
+ * they visit look hot to the clock sweep.
+ */
+bool
+bct_pin_cached_buffer(Buffer buffer, BufferTag *tag)
+{
+	BufferDesc	*bufHdr = GetBufferDescriptor(buffer - 1);
+	uint32		usagecount;
+	uint32		bufState;
+	bool		pinned;
+
+	usagecount = BUF_STATE_GET_USAGECOUNT(pg_atomic_read_u32(&bufHdr->state));
+
+#ifdef PG_VERSION_NUM_EQUAL_OR_MORE_160000
+	pinned = ReadRecentBuffer(BufTagGetRelFileLocator(tag), 
+							  tag->forkNum, tag->blockNum, buffer);
+#else
+	pinned = ReadRecentBuffer(tag->rnode, tag->forkNum, tag->blockNum, buffer);
+#endif	/* PG_VERSION_NUM >= 160000 */
+
+	if (!pinned)
+		return false;
+
+	bufState = LockBufHdr(bufHdr);
+	if (BUF_STATE_GET_USAGECOUNT(bufState) > usagecount)
+		bufState -= (BUF_STATE_GET_USAGECOUNT(bufState) - usagecount) * BUF_USAGECOUNT_ONE;
+	UnlockBufHdr(bufHdr, bufState);
+
+	return true;
+}
+
+/*
+ * Read page header of the cached page under a share content lock
+ */
+static bool
+read_cached_page_header(BufferDesc *bufHdr, BufferTag *tag, BctPageHeaderInfo *info)
+{
+	Buffer		buffer = BufferDescriptorGetBuffer(bufHdr);
+	Page		page;
+	PageHeader	phdr;
+
+	if (!bct_pin_cached_buffer(buffer, tag))
+		return false;
+
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+
+	page = BufferGetPage(buffer);
+	phdr = (PageHeader) page;
+
+	info->is_new = PageIsNew(page);
+	/* MarkBufferDirtyHint() may set the LSN under a share lock */
+	info->lsn = BufferGetLSNAtomic(buffer);
+	info->checksum = phdr->pd_checksum;
+	info->flags = phdr->pd_flags;
+
+	if (info->is_new)
+	{
+		info->free_space = 0;
+		info->line_pointers = 0;
+	}
+	else
+	{
+		info->free_space = (phdr->pd_upper > phdr->pd_lower) ? 
+			phdr->pd_upper - phdr->pd_lower : 0;
+		info->line_pointers = PageGetMaxOffsetNumber(page);
+	}
+
+	LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+	ReleaseBuffer(buffer);
+
+	return true;
+}
+
+/*
+ * Check the header of a clean cached page, the same checks as
+ * PageIsVerifiedExtended() does after a read. Returns the problem
+ * or NULL if the page is fine or was evicted.
+ *
+ * A page dirtied since the scan saw it is checked as well: the header
+ * fields are only changed under an exclusive content lock, hint bits
+ * set under a share lock never touch them, so the copy taken under
+ * the share lock has a consistent header either way.
+ *
+ * The checksum is not checked: FlushBuffer() computes it in a copy of
+ * the page, so pd_checksum of the cached page is whatever it was when
+ * the page was read.
+ */
+static char *
+verify_cached_page(BufferDesc *bufHdr, BufferTag *tag)
+{
+	Buffer			buffer = BufferDescriptorGetBuffer(bufHdr);
+	PGAlignedBlock	copy;
+	PageHeader		phdr = (PageHeader) copy.data;
+	char			*problem = NULL;
+
+	if (!bct_pin_cached_buffer(buffer, tag))
+		return NULL;
+
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+	memcpy(copy.data, BufferGetPage(buffer), BLCKSZ);
+	LockBuffer(buffer, BUFFER_LOCK_UNLOCK);
+
+	if (PageIsNew(copy.data))
+	{
+		size_t *word = (size_t *) copy.data;
+		int		i;
+
+		for (i = 0; i < BLCKSZ / sizeof(size_t); i++)
+		{
+			if (word[i] != 0)
+			{
+				problem = pstrdup("new page has non-zero contents");
+				break;
+			}
+		}
+	}
+	else if ((phdr->pd_flags & ~PD_VALID_FLAG_BITS) != 0 ||
+			 phdr->pd_lower < SizeOfPageHeaderData ||
+			 phdr->pd_lower > phdr->pd_upper ||
+			 phdr->pd_upper > phdr->pd_special ||
+			 phdr->pd_special > BLCKSZ ||
+			 phdr->pd_special != MAXALIGN(phdr->pd_special) ||
+			 PageGetPageSize(copy.data) != BLCKSZ ||
+			 PageGetPageLayoutVersion(copy.data) != PG_PAGE_LAYOUT_VERSION)
+		problem = pstrdup("invalid page header");
+
+	ReleaseBuffer(buffer);
+
+	return problem;
+}
+
+/*
+ * Scan action of pg_verify_cached_pages()
+ */
+static bool
+verify_cached_pages_action(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctScanOutput	*output = (BctScanOutput *) arg;
+	Datum			values[PG_VERIFY_CACHED_PAGES_COLS];
+	bool 			nulls[PG_VERIFY_CACHED_PAGES_COLS] = {0};
+	BufferTag		tag = bufHdr->tag;
+	char			*problem;
+
+	UnlockBufHdr(bufHdr, bufState);
+
+	/* Only clean pages, which match the page on disk, are checked */
+	if (!(BUFFER_IS_VALID(bufState)) || (bufState & BM_DIRTY))
+		return true;
+
+	problem = verify_cached_page(bufHdr, &tag);
+	if (problem == NULL)
+		return true;
+
+	values[0] = Int32GetDatum(BufferDescriptorGetBuffer(bufHdr));
+	values[1] = ObjectIdGetDatum(BCT_BUFTAG_RELNUMBER(tag));
+	values[2] = ObjectIdGetDatum(BCT_BUFTAG_DBOID(tag));
+	values[3] = ObjectIdGetDatum(BCT_BUFTAG_SPCOID(tag));
+	values[4] = CStringGetTextDatum(forkNames[tag.forkNum]);
+	values[5] = Int64GetDatum((int64) tag.blockNum);
+	values[6] = CStringGetTextDatum(problem);
+
+	tuplestore_putvalues(output->tupstore, output->tupdesc, values, nulls);
+
+	return true;
+}
+
+/*
+ * Verify the clean cached pages of a relation, database, tablespace
+ * or of the whole cache in the buffer range firstBuffer..lastBuffer.
+ * Returns a row for every page with a problem.
+ *
+ * Disjoint buffer ranges can be checked by several sessions at once.
+ */
+void
+pg_verify_cached_pages_internals(FunctionCallInfo fcinfo, text *relName, Oid dbOid, 
+								 Oid spcOid, int32 firstBuffer, int32 lastBuffer)
+{
+	Relation	rel = NULL;
+	int			nscopes = 0;
+	BctScan		scan;
+	BctScanOutput	output;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	nscopes += (relName != NULL) ? 1 : 0;
+	nscopes += OidIsValid(dbOid) ? 1 : 0;
+	nscopes += OidIsValid(spcOid) ? 1 : 0;
+
+	if (nscopes > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("only one of relname, dboid and spcoid can be specified")));
+
+	if (firstBuffer < 1 || firstBuffer > NBuffers || 
+		lastBuffer < firstBuffer || lastBuffer > NBuffers)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("buffer range must be within 1..%d", NBuffers)));
+
+	if (relName != NULL)
+	{
+		RangeVar *relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));
+
+		rel = relation_openrv(relrv, AccessShareLock);
+		other_temp_check(rel);
+	}
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	output.tupstore = tupstore;
+	output.tupdesc = tupdesc;
+
+	if (rel != NULL)
+	{
+		bct_scan_init(&scan, BCT_SCOPE_RELATION, false);
+		scan.rel = rel;
+	}
+	else if (OidIsValid(dbOid))
+	{
+		bct_scan_init(&scan, BCT_SCOPE_DATABASE, false);
+		scan.dbOid = dbOid;
+	}
+	else if (OidIsValid(spcOid))
+	{
+		bct_scan_init(&scan, BCT_SCOPE_TABLESPACE, false);
+		scan.spcOid = spcOid;
+	}
+	else
+		bct_scan_init(&scan, BCT_SCOPE_ALL_VALID, false);
+
+	scan.next_buf_id = firstBuffer - 1;
+	scan.end_buf_id = lastBuffer;
+
+	bct_scan_buffers(&scan, verify_cached_pages_action, &output);
+
+	if (rel != NULL)
+		relation_close(rel, AccessShareLock);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+}
+
+/*
+ * Show page header of a cached page without reading it from disk
+ */
+Datum
+pg_show_buffer_page_internals(FunctionCallInfo fcinfo, Buffer buffer)
+{
+	BufferDesc 	*bufHdr;
+	uint32 		bufState;
+	BufferTag	tag;
+
+	TupleDesc			tupdesc;
+	BctPageHeaderInfo	info;
+	Datum				values[PG_SHOW_BUFFER_PAGE_COLS];
+	bool 				nulls[PG_SHOW_BUFFER_PAGE_COLS] = {0};
+
+	buffer_is_not_local_check(buffer);
+
+	buffer_is_correct_check(buffer);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	bufHdr = GetBufferDescriptor(buffer - 1);
+	bufState = LockBufHdr(bufHdr);
+	tag = bufHdr->tag;
+	UnlockBufHdr(bufHdr, bufState);
+
+	if (BUFFER_IS_VALID(bufState) && read_cached_page_header(bufHdr, &tag, &info))
+	{
+		values[0] = LSNGetDatum(info.lsn);
+		values[1] = Int32GetDatum((int32) info.checksum);
+		values[2] = Int32GetDatum((int32) info.flags);
+		values[3] = BoolGetDatum((info.flags & PD_ALL_VISIBLE) != 0);
+		values[4] = BoolGetDatum((info.flags & PD_HAS_FREE_LINES) != 0);
+		values[5] = Int32GetDatum(info.free_space);
+		values[6] = Int32GetDatum(info.line_pointers);
+	}
+	else
+	{
+		memset(nulls, true, sizeof(nulls));
+	}
+
+	return HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls));
+}
+
+/*
+ * Scan action of pg_relation_cached_pages_stats()
+ */
+static bool
+relation_cached_pages_stats_action(BufferDesc *bufHdr, uint32 bufState, void *arg)
+{
+	BctCachedPagesStats	*stats = (BctCachedPagesStats *) arg;
+	BufferTag			tag = bufHdr->tag;
+	BctPageHeaderInfo	info;
+
+	UnlockBufHdr(bufHdr, bufState);
+
+	if (!(BUFFER_IS_VALID(bufState)) || 
+		!read_cached_page_header(bufHdr, &tag, &info))
+		return true;
+
+	stats->cached_pages++;
+	if (bufState & BM_DIRTY)
+		stats->dirty_pages++;
+	if (info.is_new)
+	{
+		stats->new_pages++;
+		return true;
+	}
+	if (info.flags & PD_ALL_VISIBLE)
+		stats->all_visible_pages++;
+	if (info.flags & PD_HAS_FREE_LINES)
+		stats->free_lines_pages++;
+	stats->free_space += info.free_space;
+	stats->line_pointers += info.line_pointers;
+
+	if (stats->has_lsn_threshold && info.lsn < stats->lsn_threshold)
+		stats->lsn_older_pages++;
+	if (XLogRecPtrIsInvalid(stats->min_lsn) || info.lsn < stats->min_lsn)
+		stats->min_lsn = info.lsn;
+	if (info.lsn > stats->max_lsn)
+		stats->max_lsn = info.lsn;
+
+	return true;
+}
+
+/*
+ * Aggregate page headers of all cached pages of a relation fork
+ * in one pass over the buffer descriptors
+ */
+Datum
+pg_relation_cached_pages_stats_internals(FunctionCallInfo fcinfo, text *relName, 
+										 text *forkName, XLogRecPtr lsnThreshold,
+										 bool hasLsnThreshold)
+{
+	BctScan		scan;
+	BctCachedPagesStats	stats = {0};
+
+	Relation 	rel;
+	RangeVar 	*relrv;
+
+	TupleDesc	tupdesc;
+	Datum		values[PG_RELATION_CACHED_PAGES_STATS_COLS];
+	bool 		nulls[PG_RELATION_CACHED_PAGES_STATS_COLS] = {0};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* Open relation */
+	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
+	rel = relation_openrv(relrv, AccessShareLock);
+
+	other_temp_check(rel);
+
+	bct_scan_init(&scan, BCT_SCOPE_RELATION_FORK, false);
+	scan.rel = rel;
+	scan.forkNum = forkname_to_number(text_to_cstring(forkName));	
+
+	stats.has_lsn_threshold = hasLsnThreshold;
+	stats.lsn_threshold = lsnThreshold;
+	stats.min_lsn = InvalidXLogRecPtr;
+	stats.max_lsn = InvalidXLogRecPtr;
+
+	bct_scan_buffers(&scan, relation_cached_pages_stats_action, &stats);
+
+	/* Close relation */
+	relation_close(rel, AccessShareLock);
+
+	values[0] = Int64GetDatum(stats.cached_pages);
+	values[1] = Int64GetDatum(stats.dirty_pages);
+	values[2] = Int64GetDatum(stats.new_pages);
+	values[3] = Int64GetDatum(stats.all_visible_pages);
+	values[4] = Int64GetDatum(stats.free_lines_pages);
+	values[5] = Int64GetDatum(stats.free_space);
+	values[6] = Int64GetDatum(stats.line_pointers);
+	values[7] = LSNGetDatum(stats.min_lsn);
+	values[8] = LSNGetDatum(stats.max_lsn);
+	values[9] = Int64GetDatum(stats.lsn_older_pages);
+
+	nulls[7] = nulls[8] = (stats.cached_pages == stats.new_pages);
+	nulls[9] = !hasLsnThreshold;
+
+	return HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls));
+}
+
+/*
+ * Read a specific page of a specific relation into the buffer cache
+ */
+Buffer	
+pg_read_page_into_buffer_internals(text *relName, text *forkName, BlockNumber blockNum)
+{
+	ForkNumber 	forkNum; 
+	Buffer		readBuf;	
+
+	Relation rel;
+	RangeVar *relrv;
+
+	superuser_check();
+
+	/* Open relation */
+	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
+	rel = relation_openrv(relrv, AccessExclusiveLock);
+
+	forkNum = forkname_to_number(text_to_cstring(forkName));	
+
+	other_temp_check(rel);
+
+	/* Is block number out of range for relation? */
+	block_num_not_exist_in_relation_check(rel, forkNum, blockNum);
+
+	readBuf = ReadBufferExtended(rel, forkNum, blockNum, RBM_NORMAL, NULL);
+
+	/* After the ReadBuffer function we need to release the buffer*/
+	ReleaseBuffer(readBuf);
+
+	/* Close relation*/
+	relation_close(rel, AccessExclusiveLock);
+
+    return readBuf;
+}
+
+/*
+ * Id of the shared buffer holding the block, or -1.
+ * Probes the buffer mapping table without pinning the buffer.
+ */
+int
+bct_cached_buffer_id(Relation rel, ForkNumber forkNum, BlockNumber blockNum, BufferTag *tag)
+{
+	uint32		hash;
+	LWLock		*partitionLock;
+	int			buf_id;
+
+#ifdef PG_VERSION_NUM_EQUAL_OR_MORE_160000
+	InitBufferTag(tag, &rel->rd_locator, forkNum, blockNum);
+#else
+	INIT_BUFFERTAG(*tag, rel->rd_node, forkNum, blockNum);
+#endif	/* PG_VERSION_NUM >= 160000 */
+
+	hash = BufTableHashCode(tag);
+	partitionLock = BufMappingPartitionLock(hash);
+
+	LWLockAcquire(partitionLock, LW_SHARED);
+	buf_id = BufTableLookup(tag, hash);
+	LWLockRelease(partitionLock);
+
+	return buf_id;
+}
 
-	/* Close relation*/
-	relation_close(rel, AccessExclusiveLock);
+/*
+ * Is the block in the shared buffer mapping table?
+ */
+bool
+bct_block_is_cached(Relation rel, ForkNumber forkNum, BlockNumber blockNum)
+{
+	BufferTag tag;
+
+	return bct_cached_buffer_id(rel, forkNum, blockNum, &tag) >= 0;
 }
 
 /*
- * Read a specific page of a specific relation into the buffer cache
+ * Raise usage count of the cached blocks of the range to minUsageCount.
+ * Returns the number of changed buffers.
  */
-Buffer	
-pg_read_page_into_buffer_internals(text *relName, text *forkName, BlockNumber blockNum)
+int64
+bct_raise_usagecount(Relation rel, ForkNumber forkNum, BlockNumber firstBlock, 
+					 BlockNumber lastBlock, uint32 minUsageCount)
+{
+	BlockNumber	blockNum;
+	int64		nraised = 0;
+
+	for (blockNum = firstBlock; blockNum <= lastBlock; blockNum++)
+	{
+		BufferDesc	*bufHdr;
+		BufferTag	tag;
+		uint32		bufState;
+		int			buf_id;
+
+		CHECK_FOR_INTERRUPTS();
+
+		buf_id = bct_cached_buffer_id(rel, forkNum, blockNum, &tag);
+		if (buf_id < 0)
+			continue;
+
+		bufHdr = GetBufferDescriptor(buf_id);
+		bufState = LockBufHdr(bufHdr);
+
+		/* The buffer may have been reused after the lookup */
+		if (BCT_BUFTAGS_EQUAL(bufHdr->tag, tag) && 
+			BUF_STATE_GET_USAGECOUNT(bufState) < minUsageCount)
+		{
+			bufState &= ~BUF_USAGECOUNT_MASK;
+			bufState += minUsageCount * BUF_USAGECOUNT_ONE;
+			nraised++;
+		}
+
+		UnlockBufHdr(bufHdr, bufState);
+
+		if (blockNum == MaxBlockNumber)
+			break;
+	}
+
+	return nraised;
+}
+
+static int
+block_number_comparator(const void *a, const void *b)
+{
+	BlockNumber ba = *(const BlockNumber *) a;
+	BlockNumber bb = *(const BlockNumber *) b;
+
+	if (ba < bb)
+		return -1;
+	return (ba > bb) ? 1 : 0;
+}
+
+/*
+ * Read consecutive blocks into the buffer cache
+ */
+static void
+read_block_range(Relation rel, ForkNumber forkNum, BlockNumber firstBlock, int nblocks)
+{
+#if (PG_VERSION_NUM >= 170000)
+	Buffer		buffers[MAX_IO_COMBINE_LIMIT];
+
+	/* One vectored read per io_combine_limit blocks */
+	while (nblocks > 0)
+	{
+		ReadBuffersOperation operation;
+		int			nread = Min(nblocks, io_combine_limit);
+		int			i;
+
+		operation.rel = rel;
+		operation.smgr = RelationGetSmgr(rel);
+		operation.persistence = rel->rd_rel->relpersistence;
+		operation.forknum = forkNum;
+		operation.strategy = NULL;
+
+		/* nread may be reduced if some of the blocks are already cached */
+		if (StartReadBuffers(&operation, buffers, firstBlock, &nread, 0))
+			WaitReadBuffers(&operation);
+
+		for (i = 0; i < nread; i++)
+			ReleaseBuffer(buffers[i]);
+
+		firstBlock += nread;
+		nblocks -= nread;
+	}
+#else
+	int i;
+
+	for (i = 0; i < nblocks; i++)
+		ReleaseBuffer(ReadBufferExtended(rel, forkNum, firstBlock + i, RBM_NORMAL, NULL));
+#endif	/* PG_VERSION_NUM >= 170000 */
+}
+
+/*
+ * Read a sorted list of distinct blocks into the buffer cache.
+ *
+ * Already cached blocks are skipped with a mapping table probe, and 
+ * adjacent missing blocks are merged into one vectored read. Before
+ * PostgreSQL 17 the reads are synchronous, so prefetch requests are
+ * issued BCT_PREFETCH_DISTANCE blocks ahead of them.
+ *
+ * Returns the number of blocks that were not cached.
+ */
+int64
+bct_read_blocks(Relation rel, ForkNumber forkNum, BlockNumber *blockNums, int nblocks)
+{
+	BlockNumber	*missing;
+	int			nmissing = 0;
+	int			i;
+#if (PG_VERSION_NUM < 170000)
+	int			prefetched = 0;
+#endif
+
+	missing = palloc(sizeof(BlockNumber) * Max(nblocks, 1));
+
+	for (i = 0; i < nblocks; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (!bct_block_is_cached(rel, forkNum, blockNums[i]))
+			missing[nmissing++] = blockNums[i];
+	}
+
+	i = 0;
+	while (i < nmissing)
+	{
+		int runlen = 1;
+
+		CHECK_FOR_INTERRUPTS();
+
+		while (i + runlen < nmissing && missing[i + runlen] == missing[i] + runlen)
+			runlen++;
+
+#if (PG_VERSION_NUM < 170000)
+		for (prefetched = Max(prefetched, i); 
+			 prefetched < nmissing && prefetched < i + runlen + BCT_PREFETCH_DISTANCE; 
+			 prefetched++)
+			PrefetchBuffer(rel, forkNum, missing[prefetched]);
+#endif
+
+		read_block_range(rel, forkNum, missing[i], runlen);
+
+		i += runlen;
+	}
+
+	pfree(missing);
+
+	return nmissing;
+}
+
+/*
+ * Read a list of blocks of a relation fork into the buffer cache
+ */
+int64
+pg_read_blocks_into_buffer_internals(Oid relid, text *forkName, ArrayType *blockNums)
 {
 	ForkNumber 	forkNum; 
-	Buffer		readBuf;	
+	Relation 	rel;
+	BlockNumber	nblocksInFork;
+	BlockNumber	*blocks;
+	Datum		*elems;
+	bool		*elemNulls;
+	int			nelems;
+	int			nblocks = 0;
+	int			i;
+	int64		result;
 
-	Relation rel;
-	RangeVar *relrv;
+	superuser_check();
+
+	forkNum = forkname_to_number(text_to_cstring(forkName));	
+
+	deconstruct_array(blockNums, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, 
+					  TYPALIGN_DOUBLE, &elems, &elemNulls, &nelems);
+
+	rel = relation_open(relid, AccessShareLock);
+
+	other_temp_check(rel);
+
+	nblocksInFork = RelationGetNumberOfBlocksInFork(rel, forkNum);
+
+	blocks = palloc(sizeof(BlockNumber) * Max(nelems, 1));
+
+	for (i = 0; i < nelems; i++)
+	{
+		int64 blockNum;
+
+		if (elemNulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					errmsg("block number must not be null")));
+
+		blockNum = DatumGetInt64(elems[i]);
+		int64_to_block_number_convert_check(blockNum);
+
+		if ((BlockNumber) blockNum >= nblocksInFork)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("block number %u is out of range for relation \"%s\"",
+							(BlockNumber) blockNum, RelationGetRelationName(rel))));
+
+		blocks[i] = (BlockNumber) blockNum;
+	}
+
+	/* Sort and remove duplicates */
+	qsort(blocks, nelems, sizeof(BlockNumber), block_number_comparator);
+	for (i = 0; i < nelems; i++)
+		if (nblocks == 0 || blocks[nblocks - 1] != blocks[i])
+			blocks[nblocks++] = blocks[i];
+
+	result = bct_read_blocks(rel, forkNum, blocks, nblocks);
+
+	relation_close(rel, AccessShareLock);
+
+	return result;
+}
+
+/*
+ * Read the metapage and the upper levels of a B-tree index into the
+ * buffer cache, down from the root through at most nlevels levels.
+ *
+ * The levels are read breadth-first: all pages of a level go through
+ * bct_read_blocks() at once, sorted, so that adjacent pages are read
+ * together and the rest are prefetched. The downlinks of the cached
+ * pages give the next level. Leaf pages are never read, unless the
+ * root is a leaf.
+ *
+ * Pages split concurrently may leave some of their right siblings
+ * out, which only makes the prewarm less complete.
+ *
+ * Returns the number of pages that were read.
+ */
+int64
+pg_prewarm_index_upper_levels_internals(Oid relid, int32 nlevels)
+{
+	Relation 	rel;
+	Buffer		buf;
+	Page		page;
+	BTMetaPageData *metad;
+	BlockNumber	metaBlock = BTREE_METAPAGE;
+	BlockNumber	*blocks;
+	BlockNumber	*children;
+	int			nblocks;
+	int			nchildren;
+	int			maxchildren;
+	uint32		level;
+	int32		depth;
+	int64		result;
 
 	superuser_check();
 
-	/* Open relation */
-	relrv = makeRangeVarFromNameList(textToQualifiedNameList(relName));	
-	rel = relation_openrv(relrv, AccessExclusiveLock);
+	if (nlevels <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("number of levels must be positive")));
+
+	rel = relation_open(relid, AccessShareLock);
+
+	if (rel->rd_rel->relkind != RELKIND_INDEX || rel->rd_rel->relam != BTREE_AM_OID)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				errmsg("\"%s\" is not a btree index", RelationGetRelationName(rel))));
+
+	other_temp_check(rel);
+
+	if (RelationGetNumberOfBlocks(rel) == 0)
+	{
+		relation_close(rel, AccessShareLock);
+		return 0;
+	}
+
+	result = bct_read_blocks(rel, MAIN_FORKNUM, &metaBlock, 1);
+
+	buf = ReadBuffer(rel, BTREE_METAPAGE);
+	LockBuffer(buf, BUFFER_LOCK_SHARE);
+	page = BufferGetPage(buf);
+	metad = BTPageGetMeta(page);
+
+	if (!P_ISMETA((BTPageOpaque) PageGetSpecialPointer(page)) || 
+		metad->btm_magic != BTREE_MAGIC)
+		ereport(ERROR,
+				(errcode(ERRCODE_INDEX_CORRUPTED),
+				errmsg("index \"%s\" is not a btree", RelationGetRelationName(rel))));
+
+	blocks = palloc(sizeof(BlockNumber));
+	blocks[0] = metad->btm_root;
+	nblocks = (metad->btm_root == P_NONE) ? 0 : 1;
+	level = metad->btm_level;
+
+	UnlockReleaseBuffer(buf);
+
+	maxchildren = 64;
+	children = palloc(sizeof(BlockNumber) * maxchildren);
+
+	for (depth = 0; depth < nlevels && nblocks > 0; depth++)
+	{
+		int			i;
+
+		result += bct_read_blocks(rel, MAIN_FORKNUM, blocks, nblocks);
+
+		/* The pages below level 1 are leaves */
+		if (depth + 1 == nlevels || level <= 1)
+			break;
+
+		nchildren = 0;
+
+		for (i = 0; i < nblocks; i++)
+		{
+			BTPageOpaque opaque;
+			OffsetNumber offnum;
+			OffsetNumber maxoff;
+
+			CHECK_FOR_INTERRUPTS();
+
+			buf = ReadBuffer(rel, blocks[i]);
+			LockBuffer(buf, BUFFER_LOCK_SHARE);
+			page = BufferGetPage(buf);
+			opaque = (BTPageOpaque) PageGetSpecialPointer(page);
+
+			/* The page may have been deleted or the root may have moved up */
+			if (PageIsNew(page) || P_IGNORE(opaque) || P_ISLEAF(opaque) || 
+				opaque->btpo_level != level)
+			{
+				UnlockReleaseBuffer(buf);
+				continue;
+			}
+
+			maxoff = PageGetMaxOffsetNumber(page);
+
+			for (offnum = P_FIRSTDATAKEY(opaque); 
+				 offnum <= maxoff; 
+				 offnum = OffsetNumberNext(offnum))
+			{
+				IndexTuple	itup = (IndexTuple) PageGetItem(page, PageGetItemId(page, offnum));
+
+				if (nchildren == maxchildren)
+				{
+					maxchildren *= 2;
+					children = repalloc(children, sizeof(BlockNumber) * maxchildren);
+				}
+
+				children[nchildren++] = BTreeTupleGetDownLink(itup);
+			}
+
+			UnlockReleaseBuffer(buf);
+		}
+
+		/* The children become the next level */
+		pfree(blocks);
+		blocks = children;
+		nblocks = nchildren;
+		children = palloc(sizeof(BlockNumber) * maxchildren);
+		level--;
+
+		qsort(blocks, nblocks, sizeof(BlockNumber), block_number_comparator);
+	}
+
+	pfree(blocks);
+	pfree(children);
+
+	relation_close(rel, AccessShareLock);
+
+	return result;
+}
+
+/*
+ * Extend a relation fork by nblocks zero-filled pages that stay
+ * in the buffer cache. The relation extension lock is taken once for
+ * the whole range instead of once per page by the inserting backends.
+ *
+ * New pages of a heap main fork are recorded in the free space map,
+ * so that inserts find them; heap initializes a new page on first use.
+ *
+ * Returns the number of the first added block.
+ */
+int64
+pg_extend_relation_buffers_internals(Oid relid, text *forkName, int64 nblocks)
+{
+	ForkNumber 	forkNum; 
+	Relation 	rel;
+	BlockNumber	firstBlock;
+	BlockNumber	added = 0;
+
+	superuser_check();
 
 	forkNum = forkname_to_number(text_to_cstring(forkName));	
 
+	if (nblocks <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("number of blocks must be positive")));
+
+	/* The same lock as the inserts that extend the relation */
+	rel = relation_open(relid, RowExclusiveLock);
+
 	other_temp_check(rel);
 
-	/* Is block number out of range for relation? */
-	block_num_not_exist_in_relation_check(rel, forkNum, blockNum);
+	if (!smgrexists(RelationGetSmgr(rel), forkNum))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("fork \"%s\" of relation \"%s\" does not exist",
+						forkNames[forkNum], RelationGetRelationName(rel))));
 
-	readBuf = ReadBufferExtended(rel, forkNum, blockNum, RBM_NORMAL, NULL);
+	if ((int64) RelationGetNumberOfBlocksInFork(rel, forkNum) + nblocks > 
+		(int64) MaxBlockNumber)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				errmsg("cannot extend relation \"%s\" beyond %u blocks",
+						RelationGetRelationName(rel), MaxBlockNumber)));
 
-	/* After the ReadBuffer function we need to release the buffer*/
-	ReleaseBuffer(readBuf);
+	/*
+	 * Hold the extension lock for the whole range, so no other backend
+	 * extends the relation between the batches and the range is contiguous.
+	 */
+	LockRelationForExtension(rel, ExclusiveLock);
+
+#ifdef PG_VERSION_NUM_EQUAL_OR_MORE_160000
+	firstBlock = InvalidBlockNumber;
+
+	while (added < nblocks)
+	{
+		Buffer		buffers[BCT_EXTEND_BATCH_SIZE];
+		uint32		extendBy = (uint32) Min(nblocks - added, BCT_EXTEND_BATCH_SIZE);
+		uint32		extendedBy = 0;
+		BlockNumber	first;
+		uint32		i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* May add fewer blocks than asked if this backend can't pin so many buffers */
+		first = ExtendBufferedRelBy(BMR_REL(rel), forkNum, NULL,
+									EB_SKIP_EXTENSION_LOCK,
+									extendBy, buffers, &extendedBy);
+
+		for (i = 0; i < extendedBy; i++)
+			ReleaseBuffer(buffers[i]);
+
+		if (firstBlock == InvalidBlockNumber)
+			firstBlock = first;
+		added += extendedBy;
+	}
+#else
+	firstBlock = RelationGetNumberOfBlocksInFork(rel, forkNum);
+
+	for (added = 0; added < nblocks; added++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		ReleaseBuffer(ReadBufferExtended(rel, forkNum, P_NEW, RBM_NORMAL, NULL));
+	}
+#endif	/* PG_VERSION_NUM >= 160000 */
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+
+	if (forkNum == MAIN_FORKNUM && rel->rd_rel->relam == HEAP_TABLE_AM_OID)
+	{
+		BlockNumber	blockNum;
+
+		for (blockNum = firstBlock; blockNum < firstBlock + added; blockNum++)
+			RecordPageWithFreeSpace(rel, blockNum, BLCKSZ - SizeOfPageHeaderData);
+
+		FreeSpaceMapVacuumRange(rel, firstBlock, firstBlock + added);
+	}
+
+	relation_close(rel, RowExclusiveLock);
+
+	return (int64) firstBlock;
+}
+
+/*
+ * Re-key the buffers of the old relation file to the current file of the
+ * relation, so that a relation whose file was replaced by an identical
+ * copy (for example moved to another tablespace) keeps its cache.
+ *
+ * Unlike the change_* modes, which only rewrite the buffer tag, every
+ * buffer is moved in the buffer mapping table: as in BufferAlloc(), the
+ * new entry is inserted while both partition locks are held, the tag is
+ * rewritten under the buffer header lock and then the old entry is
+ * deleted, so lookups see either the old or the new tag. A block of the
+ * new file that is already cached is a collision: its buffer is kept and
+ * the old buffer is left as it is. Pinned buffers and blocks past the end
+ * of the new file are skipped too.
+ *
+ * Returns the numbers of remapped, collided, pinned and skipped buffers.
+ */
+Datum
+pg_remap_relation_buffers_internals(FunctionCallInfo fcinfo, Oid relid, Oid oldRelNumber,
+									Oid oldSpcOid, Oid oldDbOid)
+{
+	Relation	rel;
+	bool		permanent;
+	BlockNumber	nblocks[MAX_FORKNUM + 1];
+	ForkNumber	forkNum;
+	int64		remapped = 0;
+	int64		collisions = 0;
+	int64		pinned = 0;
+	int64		pastEnd = 0;
+	int			buf_id;
+
+	TupleDesc	tupdesc;
+	Datum		values[PG_REMAP_RELATION_BUFFERS_COLS];
+	bool		nulls[PG_REMAP_RELATION_BUFFERS_COLS] = {0};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	rel = relation_open(relid, AccessExclusiveLock);
+
+	if (RelationUsesLocalBuffers(rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("this function only works with non-local buffers")));
+
+	if (!OidIsValid(oldSpcOid))
+		oldSpcOid = BCT_RELATION_SPCOID(rel);
+	if (!OidIsValid(oldDbOid))
+		oldDbOid = BCT_RELATION_DBOID(rel);
+
+	if (oldSpcOid == BCT_RELATION_SPCOID(rel) && oldDbOid == BCT_RELATION_DBOID(rel) &&
+		oldRelNumber == BCT_RELATION_RELNUMBER(rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("old relation file is the current file of relation \"%s\"",
+						RelationGetRelationName(rel))));
+
+	permanent = rel->rd_rel->relpersistence == RELPERSISTENCE_PERMANENT;
+
+	/* A buffer must not hold a block the new file does not have */
+	for (forkNum = 0; forkNum <= MAX_FORKNUM; forkNum++)
+		nblocks[forkNum] = smgrexists(RelationGetSmgr(rel), forkNum) ?
+			RelationGetNumberOfBlocksInFork(rel, forkNum) : 0;
+
+	for (buf_id = 0; buf_id < NBuffers; buf_id++)
+	{
+		BufferDesc	*bufHdr = GetBufferDescriptor(buf_id);
+		BufferTag	oldTag;
+		BufferTag	newTag;
+		uint32		oldHash;
+		uint32		newHash;
+		LWLock		*oldPartitionLock;
+		LWLock		*newPartitionLock;
+		uint32		bufState;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufState = LockBufHdr(bufHdr);
+		oldTag = bufHdr->tag;
+		UnlockBufHdr(bufHdr, bufState);
+
+		if (!(bufState & BM_TAG_VALID) ||
+			BCT_BUFTAG_SPCOID(oldTag) != oldSpcOid ||
+			BCT_BUFTAG_DBOID(oldTag) != oldDbOid ||
+			BCT_BUFTAG_RELNUMBER(oldTag) != oldRelNumber)
+			continue;
+
+		if (oldTag.blockNum >= nblocks[oldTag.forkNum])
+		{
+			pastEnd++;
+			continue;
+		}
+
+		newTag = oldTag;
+		BCT_BUFTAG_SPCOID(newTag) = BCT_RELATION_SPCOID(rel);
+		BCT_BUFTAG_DBOID(newTag) = BCT_RELATION_DBOID(rel);
+		BCT_BUFTAG_RELNUMBER(newTag) = BCT_RELATION_RELNUMBER(rel);
+
+		oldHash = BufTableHashCode(&oldTag);
+		newHash = BufTableHashCode(&newTag);
+		oldPartitionLock = BufMappingPartitionLock(oldHash);
+		newPartitionLock = BufMappingPartitionLock(newHash);
+
+		/* Lock the partitions in address order to avoid deadlocks, as BufferAlloc() did */
+		if (oldPartitionLock < newPartitionLock)
+		{
+			LWLockAcquire(oldPartitionLock, LW_EXCLUSIVE);
+			LWLockAcquire(newPartitionLock, LW_EXCLUSIVE);
+		}
+		else if (oldPartitionLock > newPartitionLock)
+		{
+			LWLockAcquire(newPartitionLock, LW_EXCLUSIVE);
+			LWLockAcquire(oldPartitionLock, LW_EXCLUSIVE);
+		}
+		else
+			LWLockAcquire(newPartitionLock, LW_EXCLUSIVE);
+
+		if (BufTableInsert(&newTag, newHash, buf_id) >= 0)
+			collisions++;
+		else
+		{
+			/* The buffer may have been replaced or pinned while it was unlocked */
+			bufState = LockBufHdr(bufHdr);
+
+			if (!(bufState & BM_TAG_VALID) || !BCT_BUFTAGS_EQUAL(bufHdr->tag, oldTag) ||
+				BUF_STATE_GET_REFCOUNT(bufState) != 0)
+			{
+				bool	isPinned = (bufState & BM_TAG_VALID) &&
+					BCT_BUFTAGS_EQUAL(bufHdr->tag, oldTag);
+
+				UnlockBufHdr(bufHdr, bufState);
+				BufTableDelete(&newTag, newHash);
+
+				if (isPinned)
+					pinned++;
+			}
+			else
+			{
+				bufHdr->tag = newTag;
+				if (permanent)
+					bufState |= BM_PERMANENT;
+				else
+					bufState &= ~BM_PERMANENT;
+
+				UnlockBufHdr(bufHdr, bufState);
+				BufTableDelete(&oldTag, oldHash);
+				remapped++;
+			}
+		}
+
+		LWLockRelease(oldPartitionLock);
+		if (oldPartitionLock != newPartitionLock)
+			LWLockRelease(newPartitionLock);
+	}
 
-	/* Close relation*/
 	relation_close(rel, AccessExclusiveLock);
 
-    return readBuf;
-}
\ No newline at end of file
+	values[0] = Int64GetDatum(remapped);
+	values[1] = Int64GetDatum(collisions);
+	values[2] = Int64GetDatum(pinned);
+	values[3] = Int64GetDatum(pastEnd);
+
+	return HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values, nulls));
+}
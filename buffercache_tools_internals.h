@@ -12,10 +12,16 @@
 
 #include "postgres.h"
 
+#include "access/xact.h"
+#include "access/xlogdefs.h"
 #include "catalog/pg_database.h"
+#include "datatype/timestamp.h"
 #include "funcapi.h"
 #include "storage/bufmgr.h"
+#include "storage/lockdefs.h"
+#include "storage/lwlock.h"
 #include "storage/buf_internals.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 
 /*
@@ -30,10 +36,165 @@ typedef enum BufProcFunc {
 	BCT_CHANGE_RELNUMBER,
 	BCT_CHANGE_FORKNUM,
 	BCT_CHANGE_BLOCKNUM,
-	BCT_INVALIDATE
+	BCT_INVALIDATE,
+	BCT_FLUSH_BALANCED,
+	BCT_CHANGE_USAGECOUNT,
+	BCT_FLUSH_OLDER_THAN,
+	BCT_EVICT
 } BufProcFunc;
 
-#define MAX_BPF_NUM	BCT_INVALIDATE
+#define MAX_BPF_NUM	BCT_EVICT
+
+/*
+ * Buffer tag fields for all supported versions
+ */
+#if (PG_VERSION_NUM >= 160000)
+#define BCT_BUFTAG_SPCOID(_bct_tag_)		((_bct_tag_).spcOid)
+#define BCT_BUFTAG_DBOID(_bct_tag_)			((_bct_tag_).dbOid)
+#define BCT_BUFTAG_RELNUMBER(_bct_tag_)		((_bct_tag_).relNumber)
+#define BCT_BUFTAGS_EQUAL(_bct_a_, _bct_b_)	BufferTagsEqual(&(_bct_a_), &(_bct_b_))
+#define BCT_RELATION_SPCOID(_bct_rel_)		((_bct_rel_)->rd_locator.spcOid)
+#define BCT_RELATION_DBOID(_bct_rel_)		((_bct_rel_)->rd_locator.dbOid)
+#define BCT_RELATION_RELNUMBER(_bct_rel_)	((_bct_rel_)->rd_locator.relNumber)
+#else
+#define BCT_BUFTAG_SPCOID(_bct_tag_)		((_bct_tag_).rnode.spcNode)
+#define BCT_BUFTAG_DBOID(_bct_tag_)			((_bct_tag_).rnode.dbNode)
+#define BCT_BUFTAG_RELNUMBER(_bct_tag_)		((_bct_tag_).rnode.relNode)
+#define BCT_BUFTAGS_EQUAL(_bct_a_, _bct_b_)	BUFFERTAGS_EQUAL(_bct_a_, _bct_b_)
+#define BCT_RELATION_SPCOID(_bct_rel_)		((_bct_rel_)->rd_node.spcNode)
+#define BCT_RELATION_DBOID(_bct_rel_)		((_bct_rel_)->rd_node.dbNode)
+#define BCT_RELATION_RELNUMBER(_bct_rel_)	((_bct_rel_)->rd_node.relNode)
+#endif	/* PG_VERSION_NUM >= 160000 */
+
+/*
+ * Dirty buffer queued for a balanced flush
+ */
+typedef struct BctFlushItem {
+	BufferTag	tag;
+	int			buf_id;
+} BctFlushItem;
+
+/*
+ * Dirty buffers collected by a sweep in a bulk flush mode
+ */
+typedef struct BctFlushQueue {
+	BctFlushItem	*items;
+	int				nitems;
+	int				maxitems;
+	BufProcFunc		buf_proc_func;
+	bool			has_lsn_bound;	/* only pages up to lsn_bound are written */
+	XLogRecPtr		lsn_bound;
+	XLogRecPtr		max_lsn;		/* WAL to flush before writing the pages */
+} BctFlushQueue;
+
+/*
+ * Cached page in a buffer residency snapshot
+ */
+typedef struct BctResidencyEntry {
+	Oid			spcOid;
+	Oid			dbOid;
+	Oid			relNumber;
+	BlockNumber	blockNum;
+	uint8		forkNum;
+	uint8		usagecount;
+	uint16		padding;
+} BctResidencyEntry;
+
+/*
+ * Contents of the bytea returned by pg_buffer_residency_snapshot().
+ * Entries are sorted by tablespace, database, relation, fork and block.
+ */
+typedef struct BctResidencySnapshot {
+	uint32				magic;
+	uint32				version;
+	uint32				nentries;
+	BctResidencyEntry	entries[FLEXIBLE_ARRAY_MEMBER];
+} BctResidencySnapshot;
+
+/*
+ * Contents of the bytea returned by pg_relation_residency_bitmap().
+ * data holds one bit per block (block 0 is the lowest bit of the first
+ * byte) or, with BCT_RESIDENCY_BITMAP_RLE, varint lengths of alternating
+ * runs of not cached and cached blocks, starting with a not cached run.
+ */
+typedef struct BctResidencyBitmap {
+	uint32		magic;
+	uint16		version;
+	uint16		flags;
+	uint32		nblocks;
+	uint8		data[FLEXIBLE_ARRAY_MEMBER];
+} BctResidencyBitmap;
+
+#define BCT_RESIDENCY_BITMAP_RLE	0x0001
+
+/*
+ * Coverages of buffer sweeps
+ */
+typedef enum BctScope {
+	BCT_SCOPE_BUFFER,
+	BCT_SCOPE_RELATION_FORK,
+	BCT_SCOPE_RELATION,
+	BCT_SCOPE_DATABASE,
+	BCT_SCOPE_TABLESPACE,
+	BCT_SCOPE_ALL_VALID,
+	BCT_SCOPE_PAGE
+} BctScope;
+
+#define MAX_BCT_SCOPE_NUM	BCT_SCOPE_PAGE
+
+/*
+ * Number of buckets of the latency histograms.
+ * Bucket i counts durations below 2^(i+1) microseconds, the last
+ * bucket counts all longer ones.
+ */
+#define BCT_STATS_HIST_BUCKETS	32
+
+/*
+ * Counters of the buffer sweep executed by the current backend
+ */
+typedef struct BctSweepState {
+	bool		active;
+	BctScope	scope;
+	BufProcFunc	buf_proc_func;
+	TimestampTz	start_time;
+	uint64		buffers_scanned;
+	uint64		buffers_processed;
+	uint64		buffers_skipped;	/* pinned by other backends, not dropped */
+	uint64		bytes_written;
+	int			max_flush_rate;		/* buffers per second, 0 is unlimited */
+	uint64		throttled_writes;	/* writes already checked by throttling */
+	uint64		lock_waits;			/* content locks that were not free */
+	uint64		lock_wait_time;		/* microseconds */
+	uint64		lock_wait_hist[BCT_STATS_HIST_BUCKETS];
+} BctSweepState;
+
+extern BctSweepState bct_sweep;
+
+/*
+ * LWLocks of the extension tranche
+ */
+typedef enum BctLWLockId {
+	BCT_LWLOCK_MRC,
+	BCT_LWLOCK_STATS,
+	BCT_LWLOCK_JOBS,
+	BCT_LWLOCK_HOT_BLOCKS,
+	BCT_NUM_LWLOCKS
+} BctLWLockId;
+
+/*
+ * GUC variables
+ */
+extern int	bct_max_flush_rate;
+extern char *bct_worker_database;
+extern int	bct_worker_naptime;
+extern double bct_mrc_sample_rate;
+extern int	bct_mrc_max_tracked;
+extern int	bct_mrc_sample_interval;
+extern int	bct_hot_blocks_max_tracked;
+extern int	bct_hot_blocks_sample_interval;
+
+extern const char *const bufProcFuncNames[];
+extern const char *const bctScopeNames[];
 
 /*-------------------------------------------------------------------------
  * 								function Headers 
@@ -91,6 +252,156 @@ extern void pg_show_buffer_internals(FunctionCallInfo fcinfo, Buffer buffer);
 
 extern void pg_show_relation_buffers_internals(FunctionCallInfo fcinfo, text *relname);
 
+extern Datum pg_show_buffers_internals(FunctionCallInfo fcinfo);
+
+extern Datum pg_show_buffer_page_internals(FunctionCallInfo fcinfo, Buffer buffer);
+
+extern Datum pg_buffer_strategy_internals(FunctionCallInfo fcinfo);
+
+extern Datum pg_relation_cached_pages_stats_internals(FunctionCallInfo fcinfo, text *relName,
+													  text *forkName, XLogRecPtr lsnThreshold,
+													  bool hasLsnThreshold);
+
+extern void pg_verify_cached_pages_internals(FunctionCallInfo fcinfo, text *relName, 
+											 Oid dbOid, Oid spcOid, 
+											 int32 firstBuffer, int32 lastBuffer);
+
+extern bool bct_pin_cached_buffer(Buffer buffer, BufferTag *tag);
+
+extern int64 pg_read_blocks_into_buffer_internals(Oid relid, text *forkName, 
+												  ArrayType *blockNums);
+
+extern int64 pg_prewarm_index_upper_levels_internals(Oid relid, int32 nlevels);
+
+extern int64 pg_extend_relation_buffers_internals(Oid relid, text *forkName, int64 nblocks);
+
+extern Datum pg_remap_relation_buffers_internals(FunctionCallInfo fcinfo, Oid relid, 
+												 Oid oldRelNumber, Oid oldSpcOid, Oid oldDbOid);
+
+extern int	bct_cached_buffer_id(Relation rel, ForkNumber forkNum, BlockNumber blockNum, 
+								 BufferTag *tag);
+
+extern bool bct_block_is_cached(Relation rel, ForkNumber forkNum, BlockNumber blockNum);
+
+extern int64 bct_raise_usagecount(Relation rel, ForkNumber forkNum, BlockNumber firstBlock, 
+								  BlockNumber lastBlock, uint32 minUsageCount);
+
+extern int64 bct_read_blocks(Relation rel, ForkNumber forkNum, 
+							 BlockNumber *blockNums, int nblocks);
+
 extern ForkNumber buf_proc_func_name_to_number(const char *bpfname);
 
+extern LOCKMODE bpf_relation_lock_mode(BufProcFunc buf_proc_func);
+
+extern double dirty_buffers_fraction(Oid relid, Oid dbOid);
+
+extern int64 pg_flush_buffers_older_than_internals(XLogRecPtr lsn, text *relName, 
+												   text *forkName, Oid dbOid, Oid spcOid);
+
+/*
+ * Buffer residency snapshot functions
+ */
+extern BctResidencyEntry *bct_collect_residency(int *nentries);
+
+extern bytea *pg_buffer_residency_snapshot_internals(void);
+
+extern void pg_buffer_residency_diff_internals(FunctionCallInfo fcinfo, 
+											   bytea *before, bytea *after);
+
+extern void pg_buffer_mapping_partitions_internals(FunctionCallInfo fcinfo, 
+												   int32 topRelations, int32 sampleTime);
+
+extern bytea *pg_relation_residency_bitmap_internals(Oid relid, text *forkName, 
+													 bool compress);
+
+extern int64 pg_residency_bitmap_count_internals(bytea *bitmap);
+
+extern bytea *pg_residency_bitmap_and_internals(bytea *a, bytea *b);
+
+extern bytea *pg_residency_bitmap_diff_internals(bytea *a, bytea *b);
+
+/*
+ * Hit ratio estimation functions
+ */
+extern Size bct_mrc_shmem_size(void);
+
+extern void bct_mrc_shmem_startup(void);
+
+extern bool bct_mrc_enabled(void);
+
+extern int64 bct_mrc_sample(void);
+
+extern void bct_mrc_reset(void);
+
+extern void pg_buffer_mrc_internals(FunctionCallInfo fcinfo);
+
+/*
+ * Hottest blocks functions
+ */
+extern Size bct_hot_blocks_shmem_size(void);
+
+extern void bct_hot_blocks_shmem_startup(void);
+
+extern bool bct_hot_blocks_enabled(void);
+
+extern int64 bct_hot_blocks_sample(void);
+
+extern void bct_hot_blocks_reset(void);
+
+extern void pg_buffer_hot_blocks_internals(FunctionCallInfo fcinfo, int32 nblocks);
+
+/*
+ * Background worker functions
+ */
+extern void bct_worker_register(void);
+
+extern PGDLLEXPORT void bct_worker_main(Datum main_arg);
+
+extern Size bct_jobs_shmem_size(void);
+
+extern void bct_jobs_shmem_startup(void);
+
+extern int64 bct_job_submit(BufProcFunc buf_proc_func, const char *scopeName, bool has_target, 
+							Oid target, text *forkName, bool has_arg, int64 arg);
+
+extern bool bct_job_cancel(int64 jobId);
+
+extern PGDLLEXPORT void bct_job_main(Datum main_arg);
+
+extern void pg_buffercache_tools_jobs_internals(FunctionCallInfo fcinfo);
+
+/*
+ * Shared memory and sweep progress functions
+ */
+extern void bct_shmem_init(void);
+
+extern LWLock *bct_get_lwlock(BctLWLockId id);
+
+extern void bct_sweep_begin(BctScope scope, BufProcFunc buf_proc_func);
+
+extern void bct_sweep_buffer_scanned(void);
+
+extern void bct_sweep_buffer_processed(uint64 bytes_written);
+
+extern void bct_sweep_buffer_skipped(uint64 bytes_written);
+
+extern void bct_sweep_throttle(void);
+
+extern void bct_sweep_lock_buffer(Buffer buffer);
+
+extern void bct_sweep_end(void);
+
+extern bool bct_progress_get(int pid, uint64 *buffers_scanned, 
+							 uint64 *buffers_processed, uint64 *bytes_written);
+
+extern void bct_sweep_xact_callback(XactEvent event, void *arg);
+extern void bct_sweep_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+									   SubTransactionId parentSubid, void *arg);
+
+extern void pg_buffercache_tools_progress_internals(FunctionCallInfo fcinfo);
+
+extern void pg_buffercache_tools_stats_internals(FunctionCallInfo fcinfo);
+
+extern void bct_stats_reset(void);
+
 #endif  /* BUFFERCACHE_TOOLS_INTERNALS_H */
\ No newline at end of file
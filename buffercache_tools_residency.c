@@ -0,0 +1,833 @@
+/*-------------------------------------------------------------------------
+ *
+ * buffercache_tools_residency.c
+ *
+ * 		Snapshots of the buffer cache contents and their comparison,
+ * 		residency bitmaps of relation forks, occupancy of the buffer
+ * 		mapping partitions
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "buffercache_tools_internals.h"
+
+#include "access/relation.h"
+#include "common/relpath.h"
+#include "miscadmin.h"
+#include "port/pg_bitutils.h"
+#include "storage/proclist.h"
+#include "storage/smgr.h"
+#include "utils/rel.h"
+#include "utils/tuplestore.h"
+
+/*
+ * Identifier and version of the snapshot format
+ */
+#define BCT_RESIDENCY_SNAPSHOT_MAGIC	0x42435453	/* "BCTS" */
+#define BCT_RESIDENCY_SNAPSHOT_VERSION	1
+
+#define BCT_RESIDENCY_BITMAP_MAGIC		0x42435442	/* "BCTB" */
+#define BCT_RESIDENCY_BITMAP_VERSION	1
+
+/*
+ * Maximum length of a varint-encoded run length
+ */
+#define BCT_VARINT_MAX_LEN				5
+
+#define BCT_BITMAP_BYTES(_bct_nblocks_)	(((Size) (_bct_nblocks_) + 7) / 8)
+
+#define PG_BUFFER_RESIDENCY_DIFF_COLS	7
+#define PG_BUFFER_MAPPING_PARTITIONS_COLS	5
+
+/*
+ * Longest allowed wait sampling, milliseconds
+ */
+#define BCT_MAX_PARTITION_SAMPLE_TIME	60000
+
+#ifndef tuplestore_donestoring
+#define tuplestore_donestoring(state) 	((void) 0)
+#endif
+
+/*
+ * Per-relation counters of a snapshot diff
+ */
+typedef struct BctResidencyDiff {
+	Oid		spcOid;
+	Oid		dbOid;
+	Oid		relNumber;
+	int64	pages_added;
+	int64	pages_evicted;
+	int64	pages_retained;
+	int64	usagecount_drift;
+} BctResidencyDiff;
+
+/*
+ * Run of the snapshot entries of one relation
+ */
+typedef struct BctResidencyRun {
+	int		start;
+	int		count;
+} BctResidencyRun;
+
+static int	residency_entry_comparator(const void *a, const void *b);
+static BctResidencySnapshot *residency_snapshot_check(bytea *snapshot);
+static void residency_diff_put(Tuplestorestate *tupstore, TupleDesc tupdesc,
+							   BctResidencyDiff *diff);
+static Size residency_rle_encode(uint8 *bits, uint32 nblocks, uint8 *out, Size maxLen);
+static bytea *residency_bitmap_make(uint8 *bits, uint32 nblocks, bool compress);
+static uint8 *residency_bitmap_bits(bytea *bitmap, uint32 *nblocks, bool *compressed);
+static bytea *residency_bitmap_combine(bytea *a, bytea *b, bool subtract);
+static int	residency_run_count_comparator(const void *a, const void *b);
+
+/*
+ * Sort order of snapshot entries:
+ * tablespace, database, relation, fork, block
+ */
+static int
+residency_entry_comparator(const void *a, const void *b)
+{
+	const BctResidencyEntry *ea = (const BctResidencyEntry *) a;
+	const BctResidencyEntry *eb = (const BctResidencyEntry *) b;
+
+	if (ea->spcOid != eb->spcOid)
+		return ea->spcOid < eb->spcOid ? -1 : 1;
+	if (ea->dbOid != eb->dbOid)
+		return ea->dbOid < eb->dbOid ? -1 : 1;
+	if (ea->relNumber != eb->relNumber)
+		return ea->relNumber < eb->relNumber ? -1 : 1;
+	if (ea->forkNum != eb->forkNum)
+		return ea->forkNum < eb->forkNum ? -1 : 1;
+	if (ea->blockNum != eb->blockNum)
+		return ea->blockNum < eb->blockNum ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Collect sorted entries of all valid shared buffers.
+ * The result is palloc'd, *nentries is set to its length.
+ */
+BctResidencyEntry *
+bct_collect_residency(int *nentries)
+{
+	BctResidencyEntry	*entries;
+	int					n = 0;
+	int					i;
+
+	entries = palloc(sizeof(BctResidencyEntry) * NBuffers);
+
+	for (i = 0; i < NBuffers; i++)
+	{
+		BufferDesc	*bufHdr;
+		uint32		bufState;
+		BufferTag	tag;
+
+		CHECK_FOR_INTERRUPTS();
+
+		bufHdr = GetBufferDescriptor(i);
+
+		/* Skip free buffers without taking the header lock */
+		bufState = pg_atomic_read_u32(&bufHdr->state);
+		if (!(BUFFER_IS_VALID(bufState)))
+			continue;
+
+		bufState = LockBufHdr(bufHdr);
+		tag = bufHdr->tag;
+		UnlockBufHdr(bufHdr, bufState);
+
+		if (!(BUFFER_IS_VALID(bufState)))
+			continue;
+
+		entries[n].spcOid = BCT_BUFTAG_SPCOID(tag);
+		entries[n].dbOid = BCT_BUFTAG_DBOID(tag);
+		entries[n].relNumber = BCT_BUFTAG_RELNUMBER(tag);
+		entries[n].blockNum = tag.blockNum;
+		entries[n].forkNum = (uint8) tag.forkNum;
+		entries[n].usagecount = (uint8) BUF_STATE_GET_USAGECOUNT(bufState);
+		entries[n].padding = 0;
+		n++;
+	}
+
+	qsort(entries, n, sizeof(BctResidencyEntry), residency_entry_comparator);
+
+	*nentries = n;
+	return entries;
+}
+
+/*
+ * Capture the buffer cache contents in the compact sorted format
+ */
+bytea *
+pg_buffer_residency_snapshot_internals(void)
+{
+	BctResidencyEntry		*entries;
+	BctResidencySnapshot	*snap;
+	bytea					*result;
+	int						nentries;
+	Size					size;
+
+	entries = bct_collect_residency(&nentries);
+
+	size = offsetof(BctResidencySnapshot, entries) +
+		   sizeof(BctResidencyEntry) * nentries;
+
+	result = palloc(VARHDRSZ + size);
+	SET_VARSIZE(result, VARHDRSZ + size);
+
+	snap = (BctResidencySnapshot *) VARDATA(result);
+	snap->magic = BCT_RESIDENCY_SNAPSHOT_MAGIC;
+	snap->version = BCT_RESIDENCY_SNAPSHOT_VERSION;
+	snap->nentries = nentries;
+	memcpy(snap->entries, entries, sizeof(BctResidencyEntry) * nentries);
+
+	pfree(entries);
+
+	return result;
+}
+
+/*
+ * Check that bytea is a snapshot made by pg_buffer_residency_snapshot()
+ */
+static BctResidencySnapshot *
+residency_snapshot_check(bytea *snapshot)
+{
+	BctResidencySnapshot	*snap;
+	Size					size = VARSIZE_ANY_EXHDR(snapshot);
+
+	if (size < offsetof(BctResidencySnapshot, entries))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid buffer residency snapshot")));
+
+	/* Entries are accessed in place, so the data must be aligned */
+	snap = palloc(size);
+	memcpy(snap, VARDATA_ANY(snapshot), size);
+
+	if (snap->magic != BCT_RESIDENCY_SNAPSHOT_MAGIC ||
+		snap->version != BCT_RESIDENCY_SNAPSHOT_VERSION ||
+		size != offsetof(BctResidencySnapshot, entries) +
+				sizeof(BctResidencyEntry) * (Size) snap->nentries)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid buffer residency snapshot")));
+
+	return snap;
+}
+
+static void
+residency_diff_put(Tuplestorestate *tupstore, TupleDesc tupdesc, BctResidencyDiff *diff)
+{
+	Datum	values[PG_BUFFER_RESIDENCY_DIFF_COLS];
+	bool	nulls[PG_BUFFER_RESIDENCY_DIFF_COLS] = {0};
+
+	values[0] = ObjectIdGetDatum(diff->relNumber);
+	values[1] = ObjectIdGetDatum(diff->dbOid);
+	values[2] = ObjectIdGetDatum(diff->spcOid);
+	values[3] = Int64GetDatum(diff->pages_added);
+	values[4] = Int64GetDatum(diff->pages_evicted);
+	values[5] = Int64GetDatum(diff->pages_retained);
+	values[6] = Int64GetDatum(diff->usagecount_drift);
+
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+/*
+ * Merge-join two snapshots and return per-relation
+ * counts of added, evicted and retained pages
+ */
+void
+pg_buffer_residency_diff_internals(FunctionCallInfo fcinfo, bytea *before, bytea *after)
+{
+	BctResidencySnapshot	*snapBefore;
+	BctResidencySnapshot	*snapAfter;
+	BctResidencyDiff		diff;
+	bool					haveDiff = false;
+	uint32					i = 0;
+	uint32					j = 0;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	snapBefore = residency_snapshot_check(before);
+	snapAfter = residency_snapshot_check(after);
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	while (i < snapBefore->nentries || j < snapAfter->nentries)
+	{
+		BctResidencyEntry	*eb = NULL;
+		BctResidencyEntry	*ea = NULL;
+		BctResidencyEntry	*cur;
+		int					cmp;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (i < snapBefore->nentries)
+			eb = &snapBefore->entries[i];
+		if (j < snapAfter->nentries)
+			ea = &snapAfter->entries[j];
+
+		if (eb == NULL)
+			cmp = 1;
+		else if (ea == NULL)
+			cmp = -1;
+		else
+			cmp = residency_entry_comparator(eb, ea);
+
+		cur = cmp <= 0 ? eb : ea;
+
+		/* Emit the counters of the previous relation */
+		if (haveDiff &&
+			(diff.spcOid != cur->spcOid ||
+			 diff.dbOid != cur->dbOid ||
+			 diff.relNumber != cur->relNumber))
+		{
+			residency_diff_put(tupstore, tupdesc, &diff);
+			haveDiff = false;
+		}
+
+		if (!haveDiff)
+		{
+			memset(&diff, 0, sizeof(diff));
+			diff.spcOid = cur->spcOid;
+			diff.dbOid = cur->dbOid;
+			diff.relNumber = cur->relNumber;
+			haveDiff = true;
+		}
+
+		if (cmp < 0)
+		{
+			diff.pages_evicted++;
+			i++;
+		}
+		else if (cmp > 0)
+		{
+			diff.pages_added++;
+			j++;
+		}
+		else
+		{
+			diff.pages_retained++;
+			diff.usagecount_drift += (int64) ea->usagecount - (int64) eb->usagecount;
+			i++;
+			j++;
+		}
+	}
+
+	if (haveDiff)
+		residency_diff_put(tupstore, tupdesc, &diff);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	pfree(snapBefore);
+	pfree(snapAfter);
+}
+
+/*-------------------------------------------------------------------------
+ * 						Buffer mapping partitions
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * The relation with more cached pages goes first
+ */
+static int
+residency_run_count_comparator(const void *a, const void *b)
+{
+	const BctResidencyRun *ra = (const BctResidencyRun *) a;
+	const BctResidencyRun *rb = (const BctResidencyRun *) b;
+
+	if (ra->count != rb->count)
+		return ra->count > rb->count ? -1 : 1;
+	return ra->start < rb->start ? -1 : 1;
+}
+
+/*
+ * Report per buffer mapping partition how many cached pages map to it,
+ * how many of them belong to the topRelations relations with the most 
+ * cached pages and, if sampleTime is given, how often backends were
+ * waiting for the partition lock.
+ *
+ * The partition of a page is computed the same way as in 
+ * invalidate_buffer(): BufTableHashCode() of the buffer tag modulo
+ * NUM_BUFFER_PARTITIONS.
+ */
+void
+pg_buffer_mapping_partitions_internals(FunctionCallInfo fcinfo, int32 topRelations,
+									   int32 sampleTime)
+{
+	BctResidencyEntry	*entries;
+	BctResidencyRun		*runs;
+	int					nentries;
+	int					nruns = 0;
+	int64				buffers[NUM_BUFFER_PARTITIONS] = {0};
+	int64				topBuffers[NUM_BUFFER_PARTITIONS] = {0};
+	int64				waitSamples[NUM_BUFFER_PARTITIONS] = {0};
+	int					i;
+	int					j;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	if (topRelations < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of top relations must not be negative")));
+
+	if (sampleTime < 0 || sampleTime > BCT_MAX_PARTITION_SAMPLE_TIME)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("sample time must be between 0 and %d ms",
+						BCT_MAX_PARTITION_SAMPLE_TIME)));
+
+	/* Entries of a relation are adjacent in the sorted snapshot */
+	entries = bct_collect_residency(&nentries);
+	runs = palloc(sizeof(BctResidencyRun) * Max(nentries, 1));
+
+	for (i = 0; i < nentries; i++)
+	{
+		if (nruns == 0 ||
+			entries[i].spcOid != entries[runs[nruns - 1].start].spcOid ||
+			entries[i].dbOid != entries[runs[nruns - 1].start].dbOid ||
+			entries[i].relNumber != entries[runs[nruns - 1].start].relNumber)
+		{
+			runs[nruns].start = i;
+			runs[nruns].count = 0;
+			nruns++;
+		}
+		runs[nruns - 1].count++;
+	}
+
+	qsort(runs, nruns, sizeof(BctResidencyRun), residency_run_count_comparator);
+
+	for (i = 0; i < nruns; i++)
+	{
+		for (j = runs[i].start; j < runs[i].start + runs[i].count; j++)
+		{
+			BctResidencyEntry	*entry = &entries[j];
+			BufferTag			tag;
+			int					partition;
+
+			/* The hash covers the whole tag, padding included */
+			memset(&tag, 0, sizeof(BufferTag));
+			BCT_BUFTAG_SPCOID(tag) = entry->spcOid;
+			BCT_BUFTAG_DBOID(tag) = entry->dbOid;
+			BCT_BUFTAG_RELNUMBER(tag) = entry->relNumber;
+			tag.forkNum = (ForkNumber) entry->forkNum;
+			tag.blockNum = entry->blockNum;
+
+			partition = BufTableHashCode(&tag) % NUM_BUFFER_PARTITIONS;
+
+			buffers[partition]++;
+			if (i < topRelations)
+				topBuffers[partition]++;
+		}
+	}
+
+	/*
+	 * Sample the wait queues of the partition locks once a millisecond.
+	 * The queue head is read without the wait list lock: a sample may be
+	 * stale, but only the emptiness of the queue is looked at.
+	 */
+	for (i = 0; i < sampleTime; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		for (j = 0; j < NUM_BUFFER_PARTITIONS; j++)
+		{
+			LWLock *lock = BufMappingPartitionLockByIndex(j);
+
+			if (!proclist_is_empty(&lock->waiters))
+				waitSamples[j]++;
+		}
+
+		pg_usleep(1000L);
+	}
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	for (i = 0; i < NUM_BUFFER_PARTITIONS; i++)
+	{
+		Datum	values[PG_BUFFER_MAPPING_PARTITIONS_COLS];
+		bool	nulls[PG_BUFFER_MAPPING_PARTITIONS_COLS] = {0};
+
+		values[0] = Int32GetDatum(i);
+		values[1] = Int64GetDatum(buffers[i]);
+		values[2] = Int64GetDatum(topBuffers[i]);
+		values[3] = Int64GetDatum(waitSamples[i]);
+		if (sampleTime > 0)
+			values[4] = Float8GetDatum((float8) waitSamples[i] / sampleTime);
+		else
+			nulls[3] = nulls[4] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	pfree(runs);
+	pfree(entries);
+}
+
+/*-------------------------------------------------------------------------
+ * 							Residency bitmaps
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * Encode the bits as lengths of alternating runs of not cached and
+ * cached blocks into at most maxLen bytes of out. Returns the encoded
+ * length, or maxLen + 1 as soon as the encoding does not fit.
+ */
+static Size
+residency_rle_encode(uint8 *bits, uint32 nblocks, uint8 *out, Size maxLen)
+{
+	Size	len = 0;
+	uint32	blockNum = 0;
+	bool	cached = false;
+
+	while (blockNum < nblocks)
+	{
+		uint32 run = 0;
+
+		while (blockNum < nblocks &&
+			   ((bits[blockNum / 8] >> (blockNum % 8)) & 1) == cached)
+		{
+			run++;
+			blockNum++;
+		}
+
+		/* LEB128: 7 bits per byte, the high bit marks continuation */
+		do
+		{
+			uint8 byte = run & 0x7F;
+
+			if (len >= maxLen)
+				return maxLen + 1;
+
+			run >>= 7;
+			out[len++] = run ? (byte | 0x80) : byte;
+		} while (run);
+
+		cached = !cached;
+	}
+
+	return len;
+}
+
+/*
+ * Build a bitmap bytea. With compress the run-length encoding is used
+ * if it is shorter than the plain bitmap.
+ */
+static bytea *
+residency_bitmap_make(uint8 *bits, uint32 nblocks, bool compress)
+{
+	BctResidencyBitmap	*bitmap;
+	bytea				*result;
+	uint8				*rle = NULL;
+	Size				rleLen = 0;
+	Size				dataLen = BCT_BITMAP_BYTES(nblocks);
+
+	if (compress)
+	{
+		/* An encoding longer than the plain bitmap is not used anyway */
+		rle = palloc(dataLen);
+		rleLen = residency_rle_encode(bits, nblocks, rle, dataLen);
+
+		if (rleLen < dataLen)
+			dataLen = rleLen;
+		else
+			compress = false;
+	}
+
+	result = palloc0(VARHDRSZ + offsetof(BctResidencyBitmap, data) + dataLen);
+	SET_VARSIZE(result, VARHDRSZ + offsetof(BctResidencyBitmap, data) + dataLen);
+
+	bitmap = (BctResidencyBitmap *) VARDATA(result);
+	bitmap->magic = BCT_RESIDENCY_BITMAP_MAGIC;
+	bitmap->version = BCT_RESIDENCY_BITMAP_VERSION;
+	bitmap->flags = compress ? BCT_RESIDENCY_BITMAP_RLE : 0;
+	bitmap->nblocks = nblocks;
+	memcpy(bitmap->data, compress ? rle : bits, dataLen);
+
+	if (rle)
+		pfree(rle);
+
+	return result;
+}
+
+/*
+ * Check a bitmap made by pg_relation_residency_bitmap() and
+ * return its blocks as a plain bitmap
+ */
+static uint8 *
+residency_bitmap_bits(bytea *bitmap, uint32 *nblocks, bool *compressed)
+{
+	BctResidencyBitmap	header;
+	uint8				*data = (uint8 *) VARDATA_ANY(bitmap);
+	Size				size = VARSIZE_ANY_EXHDR(bitmap);
+	Size				dataLen;
+	uint8				*bits;
+
+	if (size < offsetof(BctResidencyBitmap, data))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid buffer residency bitmap")));
+
+	/* The header is copied, the bytea data may be unaligned */
+	memcpy(&header, data, offsetof(BctResidencyBitmap, data));
+	data += offsetof(BctResidencyBitmap, data);
+	dataLen = size - offsetof(BctResidencyBitmap, data);
+
+	if (header.magic != BCT_RESIDENCY_BITMAP_MAGIC ||
+		header.version != BCT_RESIDENCY_BITMAP_VERSION ||
+		(header.flags & ~BCT_RESIDENCY_BITMAP_RLE) != 0 ||
+		(!(header.flags & BCT_RESIDENCY_BITMAP_RLE) &&
+		 dataLen != BCT_BITMAP_BYTES(header.nblocks)))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid buffer residency bitmap")));
+
+	bits = palloc0(BCT_BITMAP_BYTES(header.nblocks) + 1);
+
+	if (header.flags & BCT_RESIDENCY_BITMAP_RLE)
+	{
+		Size	pos = 0;
+		uint64	blockNum = 0;
+		bool	cached = false;
+
+		while (pos < dataLen)
+		{
+			uint64	run = 0;
+			int		shift = 0;
+			uint8	byte;
+
+			do
+			{
+				if (pos >= dataLen || shift >= 7 * BCT_VARINT_MAX_LEN)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							 errmsg("invalid buffer residency bitmap")));
+
+				byte = data[pos++];
+				run |= (uint64) (byte & 0x7F) << shift;
+				shift += 7;
+			} while (byte & 0x80);
+
+			if (blockNum + run > header.nblocks)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid buffer residency bitmap")));
+
+			if (cached)
+			{
+				uint64 i;
+
+				for (i = blockNum; i < blockNum + run; i++)
+					bits[i / 8] |= (uint8) (1 << (i % 8));
+			}
+
+			blockNum += run;
+			cached = !cached;
+		}
+
+		if (blockNum != header.nblocks)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid buffer residency bitmap")));
+	}
+	else
+	{
+		memcpy(bits, data, dataLen);
+
+		/* Bits past the last block must not be counted */
+		if (header.nblocks % 8 != 0)
+			bits[header.nblocks / 8] &= (uint8) ((1 << (header.nblocks % 8)) - 1);
+	}
+
+	*nblocks = header.nblocks;
+	if (compressed)
+		*compressed = (header.flags & BCT_RESIDENCY_BITMAP_RLE) != 0;
+
+	return bits;
+}
+
+/*
+ * Bitmap of the cached blocks of a relation fork.
+ *
+ * A small fork is probed block by block in the buffer mapping table,
+ * a fork larger than the buffer cache is found by one pass over the
+ * buffer descriptors.
+ */
+bytea *
+pg_relation_residency_bitmap_internals(Oid relid, text *forkName, bool compress)
+{
+	ForkNumber 	forkNum; 
+	Relation 	rel;
+	BlockNumber	nblocks = 0;
+	uint8		*bits;
+	bytea		*result;
+
+	forkNum = forkname_to_number(text_to_cstring(forkName));	
+
+	rel = relation_open(relid, AccessShareLock);
+
+	if (RelationUsesLocalBuffers(rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("this function only works with non-local buffers")));
+
+	if (smgrexists(RelationGetSmgr(rel), forkNum))
+		nblocks = RelationGetNumberOfBlocksInFork(rel, forkNum);
+
+	bits = palloc0(BCT_BITMAP_BYTES(nblocks) + 1);
+
+	if (nblocks <= (BlockNumber) NBuffers)
+	{
+		BlockNumber	blockNum;
+		BufferTag	tag;
+
+		for (blockNum = 0; blockNum < nblocks; blockNum++)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			if (bct_cached_buffer_id(rel, forkNum, blockNum, &tag) >= 0)
+				bits[blockNum / 8] |= (uint8) (1 << (blockNum % 8));
+		}
+	}
+	else
+	{
+		int i;
+
+		for (i = 0; i < NBuffers; i++)
+		{
+			BufferDesc	*bufHdr;
+			uint32		bufState;
+			BufferTag	tag;
+
+			CHECK_FOR_INTERRUPTS();
+
+			bufHdr = GetBufferDescriptor(i);
+
+			/* Skip free buffers without taking the header lock */
+			bufState = pg_atomic_read_u32(&bufHdr->state);
+			if (!(BUFFER_IS_VALID(bufState)))
+				continue;
+
+			bufState = LockBufHdr(bufHdr);
+			tag = bufHdr->tag;
+			UnlockBufHdr(bufHdr, bufState);
+
+			if (BUFFER_IS_VALID(bufState) &&
+				BCT_BUFTAG_SPCOID(tag) == BCT_RELATION_SPCOID(rel) &&
+				BCT_BUFTAG_DBOID(tag) == BCT_RELATION_DBOID(rel) &&
+				BCT_BUFTAG_RELNUMBER(tag) == BCT_RELATION_RELNUMBER(rel) &&
+				tag.forkNum == forkNum &&
+				tag.blockNum < nblocks)
+				bits[tag.blockNum / 8] |= (uint8) (1 << (tag.blockNum % 8));
+		}
+	}
+
+	relation_close(rel, AccessShareLock);
+
+	result = residency_bitmap_make(bits, nblocks, compress);
+	pfree(bits);
+
+	return result;
+}
+
+/*
+ * Number of cached blocks in a bitmap
+ */
+int64
+pg_residency_bitmap_count_internals(bytea *bitmap)
+{
+	uint32	nblocks;
+	uint8	*bits = residency_bitmap_bits(bitmap, &nblocks, NULL);
+	int64	result;
+
+	result = (int64) pg_popcount((const char *) bits, BCT_BITMAP_BYTES(nblocks));
+	pfree(bits);
+
+	return result;
+}
+
+/*
+ * Blocks cached in both bitmaps or, with subtract, only in the first one.
+ * The result covers the longer of the two and is compressed if the
+ * first bitmap is.
+ */
+static bytea *
+residency_bitmap_combine(bytea *a, bytea *b, bool subtract)
+{
+	uint32	nblocksA;
+	uint32	nblocksB;
+	bool	compressed;
+	uint8	*bitsA = residency_bitmap_bits(a, &nblocksA, &compressed);
+	uint8	*bitsB = residency_bitmap_bits(b, &nblocksB, NULL);
+	uint32	nblocks = Max(nblocksA, nblocksB);
+	uint8	*bits = palloc0(BCT_BITMAP_BYTES(nblocks) + 1);
+	Size	i;
+	bytea	*result;
+
+	for (i = 0; i < BCT_BITMAP_BYTES(nblocks); i++)
+	{
+		uint8 byteA = i < BCT_BITMAP_BYTES(nblocksA) ? bitsA[i] : 0;
+		uint8 byteB = i < BCT_BITMAP_BYTES(nblocksB) ? bitsB[i] : 0;
+
+		bits[i] = subtract ? (byteA & ~byteB) : (byteA & byteB);
+	}
+
+	result = residency_bitmap_make(bits, nblocks, compressed);
+
+	pfree(bitsA);
+	pfree(bitsB);
+	pfree(bits);
+
+	return result;
+}
+
+bytea *
+pg_residency_bitmap_and_internals(bytea *a, bytea *b)
+{
+	return residency_bitmap_combine(a, b, false);
+}
+
+bytea *
+pg_residency_bitmap_diff_internals(bytea *a, bytea *b)
+{
+	return residency_bitmap_combine(a, b, true);
+}
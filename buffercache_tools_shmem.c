@@ -0,0 +1,740 @@
+/*-------------------------------------------------------------------------
+ *
+ * buffercache_tools_shmem.c
+ *
+ * 		Shared memory state of the extension and progress
+ * 		reporting of buffer sweeps
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "buffercache_tools_internals.h"
+
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "port/pg_bitutils.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "utils/wait_event.h"
+#include "utils/timestamp.h"
+#include "utils/array.h"
+#include "utils/tuplestore.h"
+
+#if (PG_VERSION_NUM < 150000)
+#include "postmaster/autovacuum.h"
+#include "replication/walsender.h"
+#endif
+
+/*
+ * Index of the progress slot of the current backend
+ */
+#if (PG_VERSION_NUM >= 170000)
+#include "storage/procnumber.h"
+#define BCT_MY_PROC_INDEX	MyProcNumber
+#else
+#include "storage/backendid.h"
+#define BCT_MY_PROC_INDEX	(MyBackendId - 1)
+#endif
+
+/*
+ * Number of scanned buffers between two progress reports
+ */
+#define BCT_PROGRESS_REPORT_INTERVAL	1024
+
+#define PG_BUFFERCACHE_TOOLS_PROGRESS_COLS	8
+#define PG_BUFFERCACHE_TOOLS_STATS_COLS		11
+
+#ifndef tuplestore_donestoring
+#define tuplestore_donestoring(state) 	((void) 0)
+#endif
+
+/*
+ * Progress of the buffer sweep of one backend.
+ *
+ * The slot is written only by its owner. Readers use changecount
+ * the same way as for PgBackendStatus: an odd value means that
+ * the slot is being modified right now.
+ */
+typedef struct BctProgressSlot {
+	uint32		changecount;
+	int			pid;
+	BctScope	scope;
+	BufProcFunc	buf_proc_func;
+	TimestampTz	start_time;
+	uint64		buffers_total;
+	uint64		buffers_scanned;
+	uint64		buffers_processed;
+	uint64		bytes_written;
+} BctProgressSlot;
+
+typedef struct BctProgressShared {
+	int				nslots;
+	BctProgressSlot	slots[FLEXIBLE_ARRAY_MEMBER];
+} BctProgressShared;
+
+/*
+ * Cumulative statistics of the calls of one mode with one scope
+ */
+typedef struct BctStatsEntry {
+	uint64		calls;
+	uint64		buffers_processed;
+	uint64		bytes_written;
+	uint64		total_time;			/* microseconds */
+	uint64		lock_waits;
+	uint64		lock_wait_time;		/* microseconds */
+	uint64		duration_hist[BCT_STATS_HIST_BUCKETS];
+	uint64		lock_wait_hist[BCT_STATS_HIST_BUCKETS];
+} BctStatsEntry;
+
+/*
+ * Statistics of all scopes and modes, protected by BCT_LWLOCK_STATS
+ */
+typedef struct BctStatsShared {
+	TimestampTz		stats_reset;
+	BctStatsEntry	entries[MAX_BCT_SCOPE_NUM + 1][MAX_BPF_NUM + 1];
+} BctStatsShared;
+
+#define BCT_PROGRESS_BEGIN_WRITE(_bct_slot_) \
+	do { \
+		START_CRIT_SECTION(); \
+		(_bct_slot_)->changecount++; \
+		pg_write_barrier(); \
+	} while (0)
+
+#define BCT_PROGRESS_END_WRITE(_bct_slot_) \
+	do { \
+		pg_write_barrier(); \
+		(_bct_slot_)->changecount++; \
+		Assert(((_bct_slot_)->changecount & 1) == 0); \
+		END_CRIT_SECTION(); \
+	} while (0)
+
+/*
+ * Counters of the sweep executed by the current backend
+ */
+BctSweepState bct_sweep;
+
+/*
+ * Maximum number of buffers a sweep may write per second
+ */
+int bct_max_flush_rate = 0;
+
+static BctProgressShared *bctProgress = NULL;
+static BctProgressSlot *bctMyProgressSlot = NULL;
+static BctStatsShared *bctStats = NULL;
+static LWLockPadded *bctLocks = NULL;
+
+#if (PG_VERSION_NUM >= 150000)
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static int bct_max_backends(void);
+static Size bct_progress_shmem_size(void);
+static void bct_progress_report(void);
+static void bct_progress_clear(void);
+static void bct_progress_copy(volatile BctProgressSlot *slot, BctProgressSlot *local);
+static int	bct_stats_bucket(uint64 us);
+static void bct_stats_report(void);
+static Datum bct_stats_hist_datum(uint64 *hist);
+static void bct_shmem_request(void);
+static void bct_shmem_startup(void);
+
+/*-------------------------------------------------------------------------
+ * 							Shared memory setup
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * Number of backends that may run buffer sweeps
+ */
+static int
+bct_max_backends(void)
+{
+#if (PG_VERSION_NUM >= 150000)
+	return MaxBackends;
+#else
+	/* MaxBackends is not initialized yet while _PG_init() is running */
+	return MaxConnections + autovacuum_max_workers + 1 +
+		   max_worker_processes + max_wal_senders;
+#endif
+}
+
+static Size
+bct_progress_shmem_size(void)
+{
+	return add_size(offsetof(BctProgressShared, slots),
+					mul_size(bct_max_backends(), sizeof(BctProgressSlot)));
+}
+
+/*
+ * Install shared memory hooks.
+ * Called from _PG_init() when the library is preloaded.
+ */
+void
+bct_shmem_init(void)
+{
+#if (PG_VERSION_NUM >= 150000)
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = bct_shmem_request;
+#else
+	bct_shmem_request();
+#endif
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = bct_shmem_startup;
+}
+
+static void
+bct_shmem_request(void)
+{
+#if (PG_VERSION_NUM >= 150000)
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+#endif
+
+	RequestAddinShmemSpace(add_size(add_size(add_size(bct_progress_shmem_size(),
+													  sizeof(BctStatsShared)),
+											 add_size(bct_mrc_shmem_size(),
+													  bct_jobs_shmem_size())),
+									bct_hot_blocks_shmem_size()));
+	RequestNamedLWLockTranche("buffercache_tools", BCT_NUM_LWLOCKS);
+}
+
+static void
+bct_shmem_startup(void)
+{
+	bool found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	bctProgress = ShmemInitStruct("buffercache_tools progress",
+								  bct_progress_shmem_size(), &found);
+	if (!found)
+	{
+		memset(bctProgress, 0, bct_progress_shmem_size());
+		bctProgress->nslots = bct_max_backends();
+	}
+
+	bctStats = ShmemInitStruct("buffercache_tools stats",
+							   sizeof(BctStatsShared), &found);
+	if (!found)
+	{
+		memset(bctStats, 0, sizeof(BctStatsShared));
+		bctStats->stats_reset = GetCurrentTimestamp();
+	}
+
+	bctLocks = GetNamedLWLockTranche("buffercache_tools");
+
+	bct_mrc_shmem_startup();
+	bct_hot_blocks_shmem_startup();
+	bct_jobs_shmem_startup();
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * LWLock of the extension tranche
+ */
+LWLock *
+bct_get_lwlock(BctLWLockId id)
+{
+	Assert(bctLocks != NULL);
+
+	return &bctLocks[id].lock;
+}
+
+/*-------------------------------------------------------------------------
+ * 							Sweep progress functions
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * Start counting a new buffer sweep and publish it in the progress view
+ */
+void
+bct_sweep_begin(BctScope scope, BufProcFunc buf_proc_func)
+{
+	int idx = BCT_MY_PROC_INDEX;
+
+	bct_sweep.active = true;
+	bct_sweep.scope = scope;
+	bct_sweep.buf_proc_func = buf_proc_func;
+	bct_sweep.start_time = GetCurrentTimestamp();
+	bct_sweep.buffers_scanned = 0;
+	bct_sweep.buffers_processed = 0;
+	bct_sweep.buffers_skipped = 0;
+	bct_sweep.bytes_written = 0;
+	bct_sweep.max_flush_rate = bct_max_flush_rate;
+	bct_sweep.throttled_writes = 0;
+	bct_sweep.lock_waits = 0;
+	bct_sweep.lock_wait_time = 0;
+	memset(bct_sweep.lock_wait_hist, 0, sizeof(bct_sweep.lock_wait_hist));
+
+	/* Progress reporting is available only if the library is preloaded */
+	if (bctProgress == NULL || idx < 0 || idx >= bctProgress->nslots)
+		return;
+
+	bctMyProgressSlot = &bctProgress->slots[idx];
+
+	BCT_PROGRESS_BEGIN_WRITE(bctMyProgressSlot);
+
+	bctMyProgressSlot->pid = MyProcPid;
+	bctMyProgressSlot->scope = scope;
+	bctMyProgressSlot->buf_proc_func = buf_proc_func;
+	bctMyProgressSlot->start_time = bct_sweep.start_time;
+	bctMyProgressSlot->buffers_total = (scope == BCT_SCOPE_BUFFER) ? 1 : NBuffers;
+	bctMyProgressSlot->buffers_scanned = 0;
+	bctMyProgressSlot->buffers_processed = 0;
+	bctMyProgressSlot->bytes_written = 0;
+
+	BCT_PROGRESS_END_WRITE(bctMyProgressSlot);
+}
+
+/*
+ * Copy sweep counters into the progress slot
+ */
+static void
+bct_progress_report(void)
+{
+	if (bctMyProgressSlot == NULL)
+		return;
+
+	BCT_PROGRESS_BEGIN_WRITE(bctMyProgressSlot);
+
+	bctMyProgressSlot->buffers_scanned = bct_sweep.buffers_scanned;
+	bctMyProgressSlot->buffers_processed = bct_sweep.buffers_processed;
+	bctMyProgressSlot->bytes_written = bct_sweep.bytes_written;
+
+	BCT_PROGRESS_END_WRITE(bctMyProgressSlot);
+}
+
+/*
+ * Count one scanned buffer descriptor
+ */
+void
+bct_sweep_buffer_scanned(void)
+{
+	bct_sweep.buffers_scanned++;
+
+	if (bct_sweep.buffers_scanned % BCT_PROGRESS_REPORT_INTERVAL == 0)
+		bct_progress_report();
+
+	bct_sweep_throttle();
+}
+
+/*
+ * Sleep if the sweep writes faster than buffercache_tools.max_flush_rate.
+ * Must be called only where no buffer locks are held.
+ */
+void
+bct_sweep_throttle(void)
+{
+	uint64	writes;
+	int64	target_us;
+	int64	elapsed_us;
+
+	if (bct_sweep.max_flush_rate <= 0)
+		return;
+
+	writes = bct_sweep.bytes_written / BLCKSZ;
+	if (writes == bct_sweep.throttled_writes)
+		return;
+	bct_sweep.throttled_writes = writes;
+
+	target_us = (int64) (writes * USECS_PER_SEC / bct_sweep.max_flush_rate);
+	elapsed_us = GetCurrentTimestamp() - bct_sweep.start_time;
+
+	/* Short delays are accumulated until they are worth a sleep */
+	if (target_us - elapsed_us >= 1000)
+	{
+		bct_progress_report();
+
+		(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 (target_us - elapsed_us) / 1000, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Take the exclusive content lock of a buffer processed by the sweep.
+ * The clock is read only if the lock is busy, so an uncontended
+ * lock costs nothing more than LockBuffer().
+ */
+void
+bct_sweep_lock_buffer(Buffer buffer)
+{
+	instr_time	start;
+	instr_time	duration;
+	uint64		us;
+
+	if (ConditionalLockBuffer(buffer))
+		return;
+
+	INSTR_TIME_SET_CURRENT(start);
+	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	us = INSTR_TIME_GET_MICROSEC(duration);
+
+	bct_sweep.lock_waits++;
+	bct_sweep.lock_wait_time += us;
+	bct_sweep.lock_wait_hist[bct_stats_bucket(us)]++;
+}
+
+/*
+ * Count one buffer changed by a buffer processing function
+ */
+void
+bct_sweep_buffer_processed(uint64 bytes_written)
+{
+	bct_sweep.buffers_processed++;
+	bct_sweep.bytes_written += bytes_written;
+
+	/* Flush modes that collect buffers first write them after the scan */
+	if (bct_sweep.buffers_processed % BCT_PROGRESS_REPORT_INTERVAL == 0)
+		bct_progress_report();
+}
+
+/*
+ * Count a buffer the processing function had to leave as it is,
+ * i.e. a buffer pinned by another backend that could not be dropped
+ */
+void
+bct_sweep_buffer_skipped(uint64 bytes_written)
+{
+	bct_sweep.buffers_skipped++;
+	bct_sweep.bytes_written += bytes_written;
+}
+
+/*
+ * Finish the sweep, add it to the statistics and
+ * remove it from the progress view
+ */
+void
+bct_sweep_end(void)
+{
+	if (bct_sweep.buffers_skipped > 0)
+		ereport(NOTICE,
+				(errmsg_plural(UINT64_FORMAT " buffer pinned by other backends was not dropped",
+							   UINT64_FORMAT " buffers pinned by other backends were not dropped",
+							   bct_sweep.buffers_skipped,
+							   bct_sweep.buffers_skipped)));
+
+	bct_stats_report();
+	bct_progress_clear();
+}
+
+static void
+bct_progress_clear(void)
+{
+	bct_sweep.active = false;
+
+	if (bctMyProgressSlot == NULL)
+		return;
+
+	BCT_PROGRESS_BEGIN_WRITE(bctMyProgressSlot);
+	bctMyProgressSlot->pid = 0;
+	BCT_PROGRESS_END_WRITE(bctMyProgressSlot);
+
+	bctMyProgressSlot = NULL;
+}
+
+/*
+ * A cancelled or failed sweep must not stay in the progress view.
+ * It is not counted in the statistics.
+ */
+void
+bct_sweep_xact_callback(XactEvent event, void *arg)
+{
+	if ((event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT) &&
+		bct_sweep.active)
+		bct_progress_clear();
+}
+
+/*
+ * The same for a sweep that failed in a subtransaction, for example
+ * in a PL/pgSQL block with an EXCEPTION clause. No user code runs
+ * during a sweep, so an active sweep belongs to the aborted one.
+ */
+void
+bct_sweep_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+						   SubTransactionId parentSubid, void *arg)
+{
+	if (event == SUBXACT_EVENT_ABORT_SUB && bct_sweep.active)
+		bct_progress_clear();
+}
+
+/*
+ * Copy the slot until we get a consistent snapshot of it
+ */
+static void
+bct_progress_copy(volatile BctProgressSlot *slot, BctProgressSlot *local)
+{
+	for (;;)
+	{
+		uint32 before = slot->changecount;
+
+		pg_read_barrier();
+		memcpy(local, (char *) slot, sizeof(BctProgressSlot));
+		pg_read_barrier();
+
+		if (before == slot->changecount && (before & 1) == 0)
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Counters of the sweep running in the backend with the given pid.
+ * Returns false if it doesn't run a sweep.
+ */
+bool
+bct_progress_get(int pid, uint64 *buffers_scanned, 
+				 uint64 *buffers_processed, uint64 *bytes_written)
+{
+	int i;
+
+	for (i = 0; bctProgress != NULL && i < bctProgress->nslots; i++)
+	{
+		BctProgressSlot local;
+
+		bct_progress_copy(&bctProgress->slots[i], &local);
+
+		if (local.pid != 0 && local.pid == pid)
+		{
+			*buffers_scanned = local.buffers_scanned;
+			*buffers_processed = local.buffers_processed;
+			*bytes_written = local.bytes_written;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Show progress of buffer sweeps running in all backends
+ */
+void
+pg_buffercache_tools_progress_internals(FunctionCallInfo fcinfo)
+{
+	int i;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+	Datum			values[PG_BUFFERCACHE_TOOLS_PROGRESS_COLS];
+	bool 			nulls[PG_BUFFERCACHE_TOOLS_PROGRESS_COLS] = {0};
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	for (i = 0; bctProgress != NULL && i < bctProgress->nslots; i++)
+	{
+		BctProgressSlot local;
+
+		bct_progress_copy(&bctProgress->slots[i], &local);
+
+		if (local.pid == 0)
+			continue;
+
+		values[0] = Int32GetDatum(local.pid);
+		values[1] = CStringGetTextDatum(bctScopeNames[local.scope]);
+		values[2] = CStringGetTextDatum(bufProcFuncNames[local.buf_proc_func]);
+		values[3] = Int64GetDatum((int64) local.buffers_total);
+		values[4] = Int64GetDatum((int64) local.buffers_scanned);
+		values[5] = Int64GetDatum((int64) local.buffers_processed);
+		values[6] = Int64GetDatum((int64) local.bytes_written);
+		values[7] = TimestampTzGetDatum(local.start_time);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*-------------------------------------------------------------------------
+ * 							Cumulative statistics
+ *-------------------------------------------------------------------------
+ */
+
+/*
+ * Histogram bucket of a duration in microseconds
+ */
+static int
+bct_stats_bucket(uint64 us)
+{
+	int bucket;
+
+	if (us < 2)
+		return 0;
+
+	bucket = pg_leftmost_one_pos64(us);
+
+	return Min(bucket, BCT_STATS_HIST_BUCKETS - 1);
+}
+
+/*
+ * Add the finished sweep to the statistics of its scope and mode
+ */
+static void
+bct_stats_report(void)
+{
+	BctStatsEntry	*entry;
+	uint64			us;
+	int				i;
+
+	if (bctStats == NULL || !bct_sweep.active)
+		return;
+
+	us = (uint64) Max(GetCurrentTimestamp() - bct_sweep.start_time, 0);
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_STATS), LW_EXCLUSIVE);
+
+	entry = &bctStats->entries[bct_sweep.scope][bct_sweep.buf_proc_func];
+	entry->calls++;
+	entry->buffers_processed += bct_sweep.buffers_processed;
+	entry->bytes_written += bct_sweep.bytes_written;
+	entry->total_time += us;
+	entry->lock_waits += bct_sweep.lock_waits;
+	entry->lock_wait_time += bct_sweep.lock_wait_time;
+	entry->duration_hist[bct_stats_bucket(us)]++;
+	for (i = 0; i < BCT_STATS_HIST_BUCKETS; i++)
+		entry->lock_wait_hist[i] += bct_sweep.lock_wait_hist[i];
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_STATS));
+}
+
+/*
+ * Forget the collected statistics
+ */
+void
+bct_stats_reset(void)
+{
+	if (bctStats == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("buffercache_tools must be loaded via shared_preload_libraries")));
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_STATS), LW_EXCLUSIVE);
+
+	memset(bctStats->entries, 0, sizeof(bctStats->entries));
+	bctStats->stats_reset = GetCurrentTimestamp();
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_STATS));
+}
+
+static Datum
+bct_stats_hist_datum(uint64 *hist)
+{
+	Datum	elems[BCT_STATS_HIST_BUCKETS];
+	int		i;
+
+	for (i = 0; i < BCT_STATS_HIST_BUCKETS; i++)
+		elems[i] = Int64GetDatum((int64) hist[i]);
+
+	return PointerGetDatum(construct_array(elems, BCT_STATS_HIST_BUCKETS, INT8OID,
+										   sizeof(int64), FLOAT8PASSBYVAL, TYPALIGN_DOUBLE));
+}
+
+/*
+ * Show cumulative statistics of all scopes and modes that were used
+ */
+void
+pg_buffercache_tools_stats_internals(FunctionCallInfo fcinfo)
+{
+	BctStatsShared	*local;
+	int				scope;
+	int				bpf;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+	Datum			values[PG_BUFFERCACHE_TOOLS_STATS_COLS];
+	bool 			nulls[PG_BUFFERCACHE_TOOLS_STATS_COLS] = {0};
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	if (bctStats == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("buffercache_tools must be loaded via shared_preload_libraries")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	/* Copy the statistics so that the lock is not held while building tuples */
+	local = palloc(sizeof(BctStatsShared));
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_STATS), LW_SHARED);
+	memcpy(local, bctStats, sizeof(BctStatsShared));
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_STATS));
+
+	for (scope = 0; scope <= MAX_BCT_SCOPE_NUM; scope++)
+	{
+		for (bpf = 0; bpf <= MAX_BPF_NUM; bpf++)
+		{
+			BctStatsEntry *entry = &local->entries[scope][bpf];
+
+			if (entry->calls == 0)
+				continue;
+
+			values[0] = CStringGetTextDatum(bctScopeNames[scope]);
+			values[1] = CStringGetTextDatum(bufProcFuncNames[bpf]);
+			values[2] = Int64GetDatum((int64) entry->calls);
+			values[3] = Int64GetDatum((int64) entry->buffers_processed);
+			values[4] = Int64GetDatum((int64) entry->bytes_written);
+			values[5] = Float8GetDatum((double) entry->total_time / 1000.0);
+			values[6] = Int64GetDatum((int64) entry->lock_waits);
+			values[7] = Float8GetDatum((double) entry->lock_wait_time / 1000.0);
+			values[8] = bct_stats_hist_datum(entry->duration_hist);
+			values[9] = bct_stats_hist_datum(entry->lock_wait_hist);
+			values[10] = TimestampTzGetDatum(local->stats_reset);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	pfree(local);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+}
@@ -0,0 +1,1110 @@
+/*-------------------------------------------------------------------------
+ *
+ * buffercache_tools_worker.c
+ *
+ * 		Background worker flushing dirty buffers of registered
+ * 		relations and databases, and dynamic workers running
+ * 		submitted buffer sweeps as jobs
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "buffercache_tools_internals.h"
+
+#include "access/relation.h"
+#include "commands/dbcommands.h"
+#include "commands/tablespace.h"
+#include "common/relpath.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/smgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/pg_lsn.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/wait_event.h"
+
+/*
+ * GUC variables
+ */
+char	*bct_worker_database = NULL;
+int		bct_worker_naptime = 1000;
+
+/*
+ * Entry of buffercache_tools_flush_schedule
+ */
+typedef struct BctFlushScheduleEntry {
+	int32		id;
+	Oid			relid;
+	Oid			dbOid;
+	bool		interval_expired;
+	bool		has_max_dirty_fraction;
+	double		max_dirty_fraction;
+	int32		max_flush_rate;
+} BctFlushScheduleEntry;
+
+/*
+ * Entry of buffercache_tools_keep_warm
+ */
+typedef struct BctKeepWarmEntry {
+	int32		id;
+	Oid			relid;
+	ForkNumber	forkNum;
+	int64		firstBlock;
+	int64		lastBlock;			/* -1 is the end of the fork */
+	int32		minUsageCount;		/* -1 if usage count is not raised */
+	int32		maxReadRate;
+} BctKeepWarmEntry;
+
+/*
+ * Maximum number of jobs kept in shared memory, running and finished
+ */
+#define BCT_MAX_JOBS			64
+
+#define BCT_JOB_ERROR_LEN		256
+
+#define PG_BUFFERCACHE_TOOLS_JOBS_COLS	13
+
+#ifndef tuplestore_donestoring
+#define tuplestore_donestoring(state) 	((void) 0)
+#endif
+
+typedef enum BctJobStatus {
+	BCT_JOB_FREE,
+	BCT_JOB_QUEUED,
+	BCT_JOB_RUNNING,
+	BCT_JOB_DONE,
+	BCT_JOB_FAILED,
+	BCT_JOB_CANCELLED
+} BctJobStatus;
+
+static const char *const bctJobStatusNames[] = {
+	[BCT_JOB_FREE] = "free",
+	[BCT_JOB_QUEUED] = "queued",
+	[BCT_JOB_RUNNING] = "running",
+	[BCT_JOB_DONE] = "done",
+	[BCT_JOB_FAILED] = "failed",
+	[BCT_JOB_CANCELLED] = "cancelled",
+};
+
+/*
+ * Buffer sweep submitted by pg_buffercache_tools_submit()
+ */
+typedef struct BctJob {
+	int64			id;
+	BctJobStatus	status;
+	bool			cancel_requested;
+	BufProcFunc		buf_proc_func;
+	BctScope		scope;
+	Oid				dbOid;			/* database the worker connects to */
+	Oid				userOid;
+	Oid				target;			/* relation, database or tablespace */
+	ForkNumber		forkNum;
+	bool			has_arg;
+	int64			arg;
+	int				pid;
+	TimestampTz		submitted;
+	TimestampTz		started;
+	TimestampTz		finished;
+	uint64			buffers_scanned;
+	uint64			buffers_processed;
+	uint64			bytes_written;
+	char			error[BCT_JOB_ERROR_LEN];
+} BctJob;
+
+/*
+ * Job slots, protected by BCT_LWLOCK_JOBS
+ */
+typedef struct BctJobsShared {
+	int64		next_id;
+	BctJob		jobs[BCT_MAX_JOBS];
+} BctJobsShared;
+
+static BctJobsShared *bctJobs = NULL;
+
+static TimestampTz last_mrc_sample = 0;
+static TimestampTz last_hot_blocks_sample = 0;
+
+static char *worker_extension_schema(void);
+static void worker_run_keep_warm(const char *schema);
+static int64 worker_keep_warm_entry(BctKeepWarmEntry *entry);
+static void worker_run_flush_schedule(const char *schema);
+static void worker_flush_entry(const char *schema, BctFlushScheduleEntry *entry);
+static void jobs_enabled_check(void);
+static BctScope job_scope_name_to_number(const char *scopeName);
+static int	job_find(int64 jobId);
+static void job_run(BctJob *job);
+static void job_finish(int slot, BctJobStatus status, const char *error);
+static void job_exit_callback(int code, Datum arg);
+
+/*
+ * Register the worker at postmaster start.
+ * It works only in buffercache_tools.worker_database.
+ */
+void
+bct_worker_register(void)
+{
+	BackgroundWorker worker;
+
+	if (bct_worker_database == NULL || bct_worker_database[0] == '\0')
+		return;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 10;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "buffercache_tools");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "bct_worker_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "buffercache_tools worker");
+	snprintf(worker.bgw_type, BGW_MAXLEN, "buffercache_tools worker");
+
+	RegisterBackgroundWorker(&worker);
+}
+
+/*
+ * Main loop of the worker
+ */
+void
+bct_worker_main(Datum main_arg)
+{
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(bct_worker_database, NULL, 0);
+
+	for (;;)
+	{
+		char		*schema;
+		TimestampTz	now;
+
+		(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 bct_worker_naptime, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+		SPI_connect();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pgstat_report_activity(STATE_RUNNING, "buffercache_tools worker");
+
+		/* Sample the buffer cache for the hit ratio estimator */
+		now = GetCurrentTimestamp();
+		if (bct_mrc_enabled() && bct_mrc_sample_interval > 0 &&
+			TimestampDifferenceExceeds(last_mrc_sample, now, bct_mrc_sample_interval))
+		{
+			bct_mrc_sample();
+			last_mrc_sample = now;
+		}
+
+		/* Sample the buffer cache for the hottest blocks */
+		if (bct_hot_blocks_enabled() && bct_hot_blocks_sample_interval > 0 &&
+			TimestampDifferenceExceeds(last_hot_blocks_sample, now, 
+									   bct_hot_blocks_sample_interval))
+		{
+			bct_hot_blocks_sample();
+			last_hot_blocks_sample = now;
+		}
+
+		/* Nothing to do until the extension is created */
+		schema = worker_extension_schema();
+		if (schema != NULL)
+		{
+			worker_run_keep_warm(schema);
+			worker_run_flush_schedule(schema);
+		}
+
+		SPI_finish();
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		pgstat_report_activity(STATE_IDLE, NULL);
+	}
+}
+
+/*
+ * Schema of the extension in the worker database, or NULL
+ */
+static char *
+worker_extension_schema(void)
+{
+	int		ret;
+	bool	isnull;
+	Datum	schema;
+
+	ret = SPI_execute("SELECT n.nspname "
+					  "FROM pg_catalog.pg_extension e "
+					  "JOIN pg_catalog.pg_namespace n ON n.oid = e.extnamespace "
+					  "WHERE e.extname = 'buffercache_tools'", true, 1);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute failed: error code %d", ret);
+
+	if (SPI_processed == 0)
+		return NULL;
+
+	schema = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+
+	return quote_identifier(pstrdup(NameStr(*DatumGetName(schema))));
+}
+
+/*
+ * Read evicted blocks of the relations in the keep-warm list
+ */
+static void
+worker_run_keep_warm(const char *schema)
+{
+	StringInfoData		query;
+	BctKeepWarmEntry	*entries;
+	uint64				nentries;
+	uint64				i;
+	int					ret;
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT id, relid, fork, first_block, "
+					 "       coalesce(last_block, -1), coalesce(min_usagecount, -1), "
+					 "       max_read_rate "
+					 "FROM %s.buffercache_tools_keep_warm "
+					 "WHERE enabled ORDER BY id", schema);
+
+	ret = SPI_execute(query.data, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute failed: error code %d", ret);
+
+	/* Copy the entries, SPI_tuptable is replaced by the next queries */
+	nentries = SPI_processed;
+	entries = palloc0(sizeof(BctKeepWarmEntry) * Max(nentries, 1));
+
+	for (i = 0; i < nentries; i++)
+	{
+		HeapTuple	tuple = SPI_tuptable->vals[i];
+		TupleDesc	tupdesc = SPI_tuptable->tupdesc;
+		bool		isnull;
+
+		entries[i].id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		entries[i].relid = DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 2, &isnull));
+		entries[i].forkNum = forkname_to_number(SPI_getvalue(tuple, tupdesc, 3));
+		entries[i].firstBlock = DatumGetInt64(SPI_getbinval(tuple, tupdesc, 4, &isnull));
+		entries[i].lastBlock = DatumGetInt64(SPI_getbinval(tuple, tupdesc, 5, &isnull));
+		entries[i].minUsageCount = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 6, &isnull));
+		entries[i].maxReadRate = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 7, &isnull));
+	}
+
+	for (i = 0; i < nentries; i++)
+	{
+		int64 nread;
+
+		CHECK_FOR_INTERRUPTS();
+
+		nread = worker_keep_warm_entry(&entries[i]);
+		if (nread < 0)
+			continue;
+
+		resetStringInfo(&query);
+		appendStringInfo(&query,
+						 "UPDATE %s.buffercache_tools_keep_warm "
+						 "SET last_check = now(), blocks_restored = blocks_restored + "
+						 INT64_FORMAT " WHERE id = %d",
+						 schema, nread, entries[i].id);
+
+		ret = SPI_execute(query.data, false, 0);
+		if (ret != SPI_OK_UPDATE)
+			elog(ERROR, "SPI_execute failed: error code %d", ret);
+	}
+
+	pfree(entries);
+	pfree(query.data);
+}
+
+/*
+ * Read the blocks of the entry that are not in the cache,
+ * at most max_read_rate blocks per second.
+ * Returns the number of read blocks or -1 if the relation is gone.
+ */
+static int64
+worker_keep_warm_entry(BctKeepWarmEntry *entry)
+{
+	Relation	rel;
+	BlockNumber	nblocksInFork;
+	BlockNumber	firstBlock;
+	BlockNumber	lastBlock;
+	BlockNumber	blockNum;
+	BlockNumber	*missing;
+	int64		budget;
+	int			nmissing = 0;
+	int64		nread;
+
+	rel = try_relation_open(entry->relid, AccessShareLock);
+	if (rel == NULL)
+		return -1;
+
+	/* Temporary relations are not in shared buffers */
+	if (RelationUsesLocalBuffers(rel) ||
+		!smgrexists(RelationGetSmgr(rel), entry->forkNum))
+	{
+		relation_close(rel, AccessShareLock);
+		return 0;
+	}
+
+	nblocksInFork = RelationGetNumberOfBlocksInFork(rel, entry->forkNum);
+
+	if (nblocksInFork == 0 || entry->firstBlock >= (int64) nblocksInFork)
+	{
+		relation_close(rel, AccessShareLock);
+		return 0;
+	}
+
+	firstBlock = (BlockNumber) entry->firstBlock;
+	if (entry->lastBlock < 0 || entry->lastBlock >= (int64) nblocksInFork)
+		lastBlock = nblocksInFork - 1;
+	else
+		lastBlock = (BlockNumber) entry->lastBlock;
+
+	/* Blocks that may be read during one round of the worker */
+	if (entry->maxReadRate > 0)
+		budget = Max((int64) entry->maxReadRate * bct_worker_naptime / 1000, 1);
+	else
+		budget = (int64) lastBlock - firstBlock + 1;
+
+	missing = palloc(sizeof(BlockNumber) * Min(budget, (int64) lastBlock - firstBlock + 1));
+
+	for (blockNum = firstBlock; blockNum <= lastBlock && nmissing < budget; blockNum++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (!bct_block_is_cached(rel, entry->forkNum, blockNum))
+			missing[nmissing++] = blockNum;
+	}
+
+	nread = bct_read_blocks(rel, entry->forkNum, missing, nmissing);
+
+	if (entry->minUsageCount > 0)
+		bct_raise_usagecount(rel, entry->forkNum, firstBlock, lastBlock,
+							 (uint32) entry->minUsageCount);
+
+	pfree(missing);
+	relation_close(rel, AccessShareLock);
+
+	return nread;
+}
+
+/*
+ * Flush every enabled entry whose interval has expired
+ * or whose dirty watermark is crossed
+ */
+static void
+worker_run_flush_schedule(const char *schema)
+{
+	StringInfoData			query;
+	BctFlushScheduleEntry	*entries;
+	uint64					nentries;
+	uint64					i;
+	int						ret;
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT id, relid, dboid, "
+					 "       last_run IS NULL OR last_run + flush_interval <= now(), "
+					 "       max_dirty_fraction, max_flush_rate "
+					 "FROM %s.buffercache_tools_flush_schedule "
+					 "WHERE enabled ORDER BY id", schema);
+
+	ret = SPI_execute(query.data, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute failed: error code %d", ret);
+
+	/* Copy the entries, SPI_tuptable is replaced by the next queries */
+	nentries = SPI_processed;
+	entries = palloc0(sizeof(BctFlushScheduleEntry) * Max(nentries, 1));
+
+	for (i = 0; i < nentries; i++)
+	{
+		HeapTuple	tuple = SPI_tuptable->vals[i];
+		TupleDesc	tupdesc = SPI_tuptable->tupdesc;
+		bool		isnull;
+		Datum		value;
+
+		entries[i].id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+
+		value = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+		entries[i].relid = isnull ? InvalidOid : DatumGetObjectId(value);
+
+		value = SPI_getbinval(tuple, tupdesc, 3, &isnull);
+		entries[i].dbOid = isnull ? InvalidOid : DatumGetObjectId(value);
+
+		entries[i].interval_expired =
+			DatumGetBool(SPI_getbinval(tuple, tupdesc, 4, &isnull));
+
+		value = SPI_getbinval(tuple, tupdesc, 5, &isnull);
+		entries[i].has_max_dirty_fraction = !isnull;
+		if (!isnull)
+			entries[i].max_dirty_fraction = DatumGetFloat8(value);
+
+		entries[i].max_flush_rate =
+			DatumGetInt32(SPI_getbinval(tuple, tupdesc, 6, &isnull));
+	}
+
+	for (i = 0; i < nentries; i++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		worker_flush_entry(schema, &entries[i]);
+	}
+
+	pfree(entries);
+	pfree(query.data);
+}
+
+/*
+ * Flush buffers of one schedule entry if it is due and record the run
+ */
+static void
+worker_flush_entry(const char *schema, BctFlushScheduleEntry *entry)
+{
+	double			dirty_fraction;
+	char			fraction[32] = "NULL";
+	const char		*reason;
+	TimestampTz		started;
+	StringInfoData	query;
+	char			rate[32];
+	int				ret;
+
+	/* The relation may have been dropped since it was registered */
+	if (OidIsValid(entry->relid) && get_rel_name(entry->relid) == NULL)
+		return;
+
+	/* The dirty pages are counted only if the interval has not expired */
+	if (entry->interval_expired)
+		reason = "interval";
+	else if (entry->has_max_dirty_fraction)
+	{
+		dirty_fraction = dirty_buffers_fraction(entry->relid, entry->dbOid);
+		if (dirty_fraction <= entry->max_dirty_fraction)
+			return;
+
+		reason = "dirty_watermark";
+		snprintf(fraction, sizeof(fraction), "%g", dirty_fraction);
+	}
+	else
+		return;
+
+	snprintf(rate, sizeof(rate), "%d", entry->max_flush_rate);
+	SetConfigOption("buffercache_tools.max_flush_rate", rate, PGC_SUSET, PGC_S_SESSION);
+
+	started = GetCurrentTimestamp();
+
+	if (OidIsValid(entry->relid))
+	{
+		char *relname = quote_qualified_identifier(
+			get_namespace_name(get_rel_namespace(entry->relid)),
+			get_rel_name(entry->relid));
+
+		relation_buffers_handler(BCT_FLUSH, cstring_to_text(relname), NULL);
+	}
+	else
+		database_buffers_handler(BCT_FLUSH, entry->dbOid, NULL);
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "INSERT INTO %s.buffercache_tools_flush_history "
+					 "(schedule_id, started, finished, reason, dirty_fraction, "
+					 " buffers_scanned, buffers_written, bytes_written) "
+					 "VALUES (%d, '%s', now(), '%s', %s, "
+					 INT64_FORMAT ", " INT64_FORMAT ", " INT64_FORMAT ")",
+					 schema, entry->id, timestamptz_to_str(started), reason,
+					 fraction,
+					 (int64) bct_sweep.buffers_scanned,
+					 (int64) (bct_sweep.bytes_written / BLCKSZ),
+					 (int64) bct_sweep.bytes_written);
+
+	ret = SPI_execute(query.data, false, 0);
+	if (ret != SPI_OK_INSERT)
+		elog(ERROR, "SPI_execute failed: error code %d", ret);
+
+	resetStringInfo(&query);
+	appendStringInfo(&query,
+					 "UPDATE %s.buffercache_tools_flush_schedule "
+					 "SET last_run = now() WHERE id = %d",
+					 schema, entry->id);
+
+	ret = SPI_execute(query.data, false, 0);
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "SPI_execute failed: error code %d", ret);
+
+	pfree(query.data);
+}
+
+/*-------------------------------------------------------------------------
+ * 							Jobs
+ *-------------------------------------------------------------------------
+ */
+
+Size
+bct_jobs_shmem_size(void)
+{
+	return sizeof(BctJobsShared);
+}
+
+/*
+ * Called from the shared memory startup hook with AddinShmemInitLock held
+ */
+void
+bct_jobs_shmem_startup(void)
+{
+	bool found;
+
+	bctJobs = ShmemInitStruct("buffercache_tools jobs", sizeof(BctJobsShared), &found);
+	if (!found)
+	{
+		memset(bctJobs, 0, sizeof(BctJobsShared));
+		bctJobs->next_id = 1;
+	}
+}
+
+static void
+jobs_enabled_check(void)
+{
+	if (bctJobs == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("buffercache_tools must be loaded via shared_preload_libraries")));
+}
+
+/*
+ * Scopes that may be run as a job
+ */
+static BctScope
+job_scope_name_to_number(const char *scopeName)
+{
+	BctScope scope;
+
+	for (scope = BCT_SCOPE_RELATION_FORK; scope <= BCT_SCOPE_ALL_VALID; scope++)
+	{
+		if (strcmp(bctScopeNames[scope], scopeName) == 0)
+			return scope;
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid job scope \"%s\"", scopeName),
+			 errhint("Valid scopes are relation_fork, relation, database, tablespace and all_valid.")));
+
+	return BCT_SCOPE_ALL_VALID;		/* keep compiler quiet */
+}
+
+/*
+ * Slot of the job, or -1. BCT_LWLOCK_JOBS must be held.
+ */
+static int
+job_find(int64 jobId)
+{
+	int i;
+
+	for (i = 0; i < BCT_MAX_JOBS; i++)
+	{
+		if (bctJobs->jobs[i].status != BCT_JOB_FREE && bctJobs->jobs[i].id == jobId)
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Queue a buffer sweep and start a dynamic background worker for it.
+ * The worker connects to the current database as the current user.
+ */
+int64
+bct_job_submit(BufProcFunc buf_proc_func, const char *scopeName, bool has_target, 
+			   Oid target, text *forkName, bool has_arg, int64 arg)
+{
+	BctScope				scope = job_scope_name_to_number(scopeName);
+	ForkNumber				forkNum = MAIN_FORKNUM;
+	BctJob					*job;
+	int						slot = -1;
+	int						i;
+	int64					jobId;
+	BackgroundWorker		worker;
+	BackgroundWorkerHandle	*handle;
+	BgwHandleStatus			status;
+	pid_t					pid;
+
+	jobs_enabled_check();
+
+	bpf_func_nargs_check(buf_proc_func, has_arg ? 1 : 0);
+
+	if (forkName != NULL && scope != BCT_SCOPE_RELATION_FORK)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("fork can be specified only with relation_fork scope")));
+
+	if (has_target == (scope == BCT_SCOPE_ALL_VALID))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("target must be specified for all scopes except all_valid")));
+
+	switch (scope)
+	{
+		case BCT_SCOPE_RELATION_FORK:
+		case BCT_SCOPE_RELATION:
+		{
+			Relation rel = relation_open(target, AccessShareLock);
+
+			/* The worker can't see temporary relations of this session */
+			if (RelationUsesLocalBuffers(rel))
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("this function only works with non-local buffers")));
+			relation_close(rel, AccessShareLock);
+
+			if (scope == BCT_SCOPE_RELATION_FORK)
+			{
+				if (forkName == NULL)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("fork must be specified with relation_fork scope")));
+				forkNum = forkname_to_number(text_to_cstring(forkName));
+			}
+			break;
+		}
+		case BCT_SCOPE_DATABASE:
+			if (get_database_name(target) == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid database oid")));
+			break;
+		case BCT_SCOPE_TABLESPACE:
+			if (get_tablespace_name(target) == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid tablespace oid")));
+			break;
+		default:
+			break;
+	}
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_EXCLUSIVE);
+
+	/* Take a free slot or the one of the job that finished first */
+	for (i = 0; i < BCT_MAX_JOBS; i++)
+	{
+		BctJob *cur = &bctJobs->jobs[i];
+
+		if (cur->status == BCT_JOB_FREE)
+		{
+			slot = i;
+			break;
+		}
+
+		if ((cur->status == BCT_JOB_DONE || cur->status == BCT_JOB_FAILED ||
+			 cur->status == BCT_JOB_CANCELLED) &&
+			(slot < 0 || cur->finished < bctJobs->jobs[slot].finished))
+			slot = i;
+	}
+
+	if (slot < 0)
+	{
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				errmsg("too many running buffercache_tools jobs"),
+				errdetail("At most %d jobs can be queued or running.", BCT_MAX_JOBS)));
+	}
+
+	job = &bctJobs->jobs[slot];
+	memset(job, 0, sizeof(BctJob));
+	job->id = jobId = bctJobs->next_id++;
+	job->status = BCT_JOB_QUEUED;
+	job->buf_proc_func = buf_proc_func;
+	job->scope = scope;
+	job->dbOid = MyDatabaseId;
+	job->userOid = GetUserId();
+	job->target = target;
+	job->forkNum = forkNum;
+	job->has_arg = has_arg;
+	job->arg = arg;
+	job->submitted = GetCurrentTimestamp();
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main_arg = Int32GetDatum(slot);
+	memcpy(worker.bgw_extra, &jobId, sizeof(int64));
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "buffercache_tools");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "bct_job_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "buffercache_tools job " INT64_FORMAT, jobId);
+	snprintf(worker.bgw_type, BGW_MAXLEN, "buffercache_tools job");
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_EXCLUSIVE);
+		job->status = BCT_JOB_FREE;
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				errmsg("could not register background worker for buffercache_tools job"),
+				errhint("You may need to increase max_worker_processes.")));
+	}
+
+	status = WaitForBackgroundWorkerStartup(handle, &pid);
+
+	if (status == BGWH_POSTMASTER_DIED)
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				errmsg("cannot start background worker for buffercache_tools job without postmaster"),
+				errhint("Kill all remaining database processes and restart the database.")));
+
+	/* A worker that could not start leaves its job queued forever */
+	if (status == BGWH_STOPPED)
+	{
+		bool	failed = false;
+
+		LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_EXCLUSIVE);
+		if (job->id == jobId && job->status == BCT_JOB_QUEUED)
+		{
+			job->status = BCT_JOB_FAILED;
+			job->finished = GetCurrentTimestamp();
+			strlcpy(job->error, "background worker failed to start", BCT_JOB_ERROR_LEN);
+			failed = true;
+		}
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+		if (failed)
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					errmsg("could not start background worker for buffercache_tools job " INT64_FORMAT, jobId),
+					errhint("More details may be available in the server log.")));
+	}
+
+	return jobId;
+}
+
+/*
+ * Request cancellation of a queued or running job.
+ * Returns false if the job has already finished.
+ */
+bool
+bct_job_cancel(int64 jobId)
+{
+	int		slot;
+	int		pid = 0;
+	bool	result = false;
+
+	jobs_enabled_check();
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_EXCLUSIVE);
+
+	slot = job_find(jobId);
+	if (slot < 0)
+	{
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("buffercache_tools job " INT64_FORMAT " does not exist", jobId)));
+	}
+
+	if (bctJobs->jobs[slot].status == BCT_JOB_QUEUED ||
+		bctJobs->jobs[slot].status == BCT_JOB_RUNNING)
+	{
+		bctJobs->jobs[slot].cancel_requested = true;
+		pid = bctJobs->jobs[slot].pid;
+		result = true;
+	}
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+	/* A queued job sees the request when its worker starts */
+	if (pid != 0)
+		kill(pid, SIGINT);
+
+	return result;
+}
+
+/*
+ * Record the outcome of the job
+ */
+static void
+job_finish(int slot, BctJobStatus status, const char *error)
+{
+	BctJob *job = &bctJobs->jobs[slot];
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_EXCLUSIVE);
+
+	job->status = status;
+	job->pid = 0;
+	job->finished = GetCurrentTimestamp();
+	job->buffers_scanned = bct_sweep.buffers_scanned;
+	job->buffers_processed = bct_sweep.buffers_processed;
+	job->bytes_written = bct_sweep.bytes_written;
+	if (error != NULL)
+		strlcpy(job->error, error, BCT_JOB_ERROR_LEN);
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+}
+
+/*
+ * A worker terminated by FATAL error must not leave its job running
+ */
+static void
+job_exit_callback(int code, Datum arg)
+{
+	int slot = DatumGetInt32(arg);
+
+	if (bctJobs->jobs[slot].status == BCT_JOB_RUNNING &&
+		bctJobs->jobs[slot].pid == MyProcPid)
+	{
+		LWLockReleaseAll();
+		job_finish(slot, BCT_JOB_FAILED, "worker terminated");
+	}
+}
+
+/*
+ * Run the buffer sweep of the job through the same handlers
+ * as the pg_change_* functions
+ */
+static void
+job_run(BctJob *job)
+{
+	NullableDatum	bpf_args[1];
+	text			*relName = NULL;
+
+	bpf_args[0].isnull = !job->has_arg;
+	switch (job->buf_proc_func)
+	{
+		case BCT_CHANGE_SPCOID:
+		case BCT_CHANGE_DBOID:
+		case BCT_CHANGE_RELNUMBER:
+			bpf_args[0].value = ObjectIdGetDatum((Oid) job->arg);
+			break;
+		case BCT_CHANGE_FORKNUM:
+			bpf_args[0].value = Int32GetDatum((int32) job->arg);
+			break;
+		case BCT_FLUSH_OLDER_THAN:
+			bpf_args[0].value = LSNGetDatum((XLogRecPtr) job->arg);
+			break;
+		default:
+			bpf_args[0].value = Int64GetDatum(job->arg);
+			break;
+	}
+
+	if (job->scope == BCT_SCOPE_RELATION_FORK || job->scope == BCT_SCOPE_RELATION)
+	{
+		char *relname;
+
+		if (get_rel_name(job->target) == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_TABLE),
+					errmsg("relation with OID %u does not exist", job->target)));
+
+		relname = quote_qualified_identifier(
+			get_namespace_name(get_rel_namespace(job->target)),
+			get_rel_name(job->target));
+		relName = cstring_to_text(relname);
+	}
+
+	switch (job->scope)
+	{
+		case BCT_SCOPE_RELATION_FORK:
+			relation_fork_buffers_handler(job->buf_proc_func, relName,
+										  cstring_to_text(forkNames[job->forkNum]),
+										  bpf_args);
+			break;
+		case BCT_SCOPE_RELATION:
+			relation_buffers_handler(job->buf_proc_func, relName, bpf_args);
+			break;
+		case BCT_SCOPE_DATABASE:
+			database_buffers_handler(job->buf_proc_func, job->target, bpf_args);
+			break;
+		case BCT_SCOPE_TABLESPACE:
+			tablespace_buffers_handler(job->buf_proc_func, job->target, bpf_args);
+			break;
+		case BCT_SCOPE_ALL_VALID:
+			all_valid_buffers_handler(job->buf_proc_func, bpf_args);
+			break;
+		default:
+			Assert(false);
+	}
+}
+
+/*
+ * Main function of a job worker
+ */
+void
+bct_job_main(Datum main_arg)
+{
+	int				slot = DatumGetInt32(main_arg);
+	int64			jobId;
+	BctJob			job;
+	MemoryContext	jobContext = CurrentMemoryContext;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	memcpy(&jobId, MyBgworkerEntry->bgw_extra, sizeof(int64));
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_EXCLUSIVE);
+
+	if (bctJobs->jobs[slot].id != jobId || bctJobs->jobs[slot].status != BCT_JOB_QUEUED)
+	{
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+		proc_exit(0);
+	}
+
+	if (bctJobs->jobs[slot].cancel_requested)
+	{
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+		job_finish(slot, BCT_JOB_CANCELLED, NULL);
+		proc_exit(0);
+	}
+
+	bctJobs->jobs[slot].status = BCT_JOB_RUNNING;
+	bctJobs->jobs[slot].pid = MyProcPid;
+	bctJobs->jobs[slot].started = GetCurrentTimestamp();
+	job = bctJobs->jobs[slot];
+
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+	before_shmem_exit(job_exit_callback, Int32GetDatum(slot));
+
+	BackgroundWorkerInitializeConnectionByOid(job.dbOid, job.userOid, 0);
+
+	pgstat_report_appname("buffercache_tools job");
+
+	PG_TRY();
+	{
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+		pgstat_report_activity(STATE_RUNNING, "buffercache_tools job");
+
+		job_run(&job);
+
+		CommitTransactionCommand();
+		pgstat_report_activity(STATE_IDLE, NULL);
+	}
+	PG_CATCH();
+	{
+		ErrorData	*edata;
+		bool		cancelled;
+
+		MemoryContextSwitchTo(jobContext);
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		/* The failed sweep is still reported with the counters it reached */
+		AbortCurrentTransaction();
+
+		LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_SHARED);
+		cancelled = bctJobs->jobs[slot].cancel_requested;
+		LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+		job_finish(slot, cancelled ? BCT_JOB_CANCELLED : BCT_JOB_FAILED, edata->message);
+		proc_exit(0);
+	}
+	PG_END_TRY();
+
+	job_finish(slot, BCT_JOB_DONE, NULL);
+	proc_exit(0);
+}
+
+/*
+ * Show the jobs kept in shared memory with the progress of running ones
+ */
+void
+pg_buffercache_tools_jobs_internals(FunctionCallInfo fcinfo)
+{
+	BctJob			*jobs;
+	int				i;
+
+	ReturnSetInfo 	*rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+	Datum			values[PG_BUFFERCACHE_TOOLS_JOBS_COLS];
+	bool 			nulls[PG_BUFFERCACHE_TOOLS_JOBS_COLS];
+
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	jobs_enabled_check();
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* let the caller know we're sending back a tuplestore */
+	rsinfo->returnMode = SFRM_Materialize;
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	/* Copy the jobs so that the lock is not held while building tuples */
+	jobs = palloc(sizeof(BctJob) * BCT_MAX_JOBS);
+
+	LWLockAcquire(bct_get_lwlock(BCT_LWLOCK_JOBS), LW_SHARED);
+	memcpy(jobs, bctJobs->jobs, sizeof(BctJob) * BCT_MAX_JOBS);
+	LWLockRelease(bct_get_lwlock(BCT_LWLOCK_JOBS));
+
+	for (i = 0; i < BCT_MAX_JOBS; i++)
+	{
+		BctJob *job = &jobs[i];
+
+		if (job->status == BCT_JOB_FREE)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		/* A running job reports the counters of its sweep */
+		if (job->status == BCT_JOB_RUNNING)
+			bct_progress_get(job->pid, &job->buffers_scanned,
+							 &job->buffers_processed, &job->bytes_written);
+
+		values[0] = Int64GetDatum(job->id);
+		values[1] = CStringGetTextDatum(bufProcFuncNames[job->buf_proc_func]);
+		values[2] = CStringGetTextDatum(bctScopeNames[job->scope]);
+		values[3] = ObjectIdGetDatum(job->target);
+		nulls[3] = job->scope == BCT_SCOPE_ALL_VALID;
+		values[4] = CStringGetTextDatum(bctJobStatusNames[job->status]);
+		values[5] = Int32GetDatum(job->pid);
+		nulls[5] = job->pid == 0;
+		values[6] = TimestampTzGetDatum(job->submitted);
+		values[7] = TimestampTzGetDatum(job->started);
+		nulls[7] = job->started == 0;
+		values[8] = TimestampTzGetDatum(job->finished);
+		nulls[8] = job->finished == 0;
+		values[9] = Int64GetDatum((int64) job->buffers_scanned);
+		values[10] = Int64GetDatum((int64) job->buffers_processed);
+		values[11] = Int64GetDatum((int64) job->bytes_written);
+		values[12] = CStringGetTextDatum(job->error);
+		nulls[12] = job->error[0] == '\0';
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(jobs);
+
+	tuplestore_donestoring(tupstore);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+}
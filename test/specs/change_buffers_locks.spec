@@ -0,0 +1,46 @@
+# Which buffer change modes block queries on the relation.
+#
+# The flush modes and pg_read_blocks_into_buffer take AccessShareLock and
+# run concurrently with an open transaction that read the relation, the
+# other modes and pg_show_relation_buffers take AccessExclusiveLock and
+# wait for it.
+
+setup
+{
+    CREATE EXTENSION buffercache_tools;
+    CREATE TABLE test_table(col integer) WITH (autovacuum_enabled = off);
+    INSERT INTO test_table SELECT 1 FROM generate_series(1,1000);
+}
+
+teardown
+{
+    DROP TABLE test_table;
+    DROP EXTENSION buffercache_tools;
+}
+
+session s1
+step s1_begin       { BEGIN; }
+step s1_select      { SELECT count(*) FROM test_table; }
+step s1_declare     { DECLARE c CURSOR FOR SELECT * FROM test_table; }
+step s1_fetch       { FETCH 1 FROM c; }
+step s1_commit      { COMMIT; }
+
+session s2
+step s2_mark_dirty  { SELECT pg_change_relation_buffers('mark_dirty', 'test_table'); }
+step s2_flush       { SELECT pg_change_relation_buffers('flush', 'test_table'); }
+step s2_balanced    { SELECT pg_change_relation_buffers('flush_balanced', 'test_table'); }
+step s2_usagecount  { SELECT pg_change_relation_buffers('change_usagecount', 'test_table', 5::bigint); }
+step s2_show        { SELECT count(*) > 0 FROM pg_show_relation_buffers('test_table'); }
+step s2_prewarm     { SELECT pg_read_blocks_into_buffer('test_table', 'main', ARRAY[0, 1]::bigint[]); }
+step s2_invalidate  { SELECT pg_change_relation_buffers('invalidate', 'test_table'); }
+step s2_evict_first { SELECT pg_change_buffer('evict', buffernum) FROM pg_show_buffers(filter_relnumber => pg_relation_filenode('test_table')) WHERE fork = 'main' AND blocknum = 0; }
+step s2_first_cached { SELECT count(*) FROM pg_show_buffers(filter_relnumber => pg_relation_filenode('test_table')) WHERE fork = 'main' AND blocknum = 0; }
+
+permutation s1_begin s1_select s2_flush s2_balanced s1_commit
+permutation s1_begin s1_select s2_mark_dirty s1_commit
+permutation s1_begin s1_select s2_usagecount s1_commit
+permutation s1_begin s1_select s2_prewarm s2_show s1_commit
+permutation s1_begin s1_select s2_flush s2_invalidate s1_commit
+
+# A page pinned by the open cursor is not dropped, and the sweep says so
+permutation s1_begin s1_declare s1_fetch s2_evict_first s2_first_cached s1_commit s2_evict_first s2_first_cached
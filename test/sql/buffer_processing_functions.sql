@@ -129,6 +129,39 @@ SELECT pg_change_buffer(
     (SELECT blocknum FROM test_buf_src_dat)::Oid
 ); 
 
+-- Check 'change_usagecount' buffer processing function for pg_change_buffer()
+SELECT pg_change_buffer(
+    'change_usagecount', 
+    (TABLE test_buf_num), 
+    0::bigint
+);
+
+SELECT usagecount FROM pg_show_buffer((TABLE test_buf_num));
+
+SELECT pg_change_buffer(
+    'change_usagecount', 
+    (TABLE test_buf_num), 
+    5::bigint
+);
+
+SELECT usagecount FROM pg_show_buffer((TABLE test_buf_num));
+
+SELECT pg_change_buffer(
+    'change_usagecount', 
+    (TABLE test_buf_num), 
+    6::bigint
+);
+
+-- Check pg_flush_buffers_older_than()
+SELECT pg_change_buffer_by_page('mark_dirty', 'test_table', 'main', 0);
+
+-- the page was changed after 0/0, so it is not written
+SELECT pg_flush_buffers_older_than('0/0', 'test_table', 'main');
+
+SELECT pg_flush_buffers_older_than(pg_current_wal_insert_lsn(), 'test_table', 'main');
+
+SELECT pg_flush_buffers_older_than('0/0', 'test_table', dboid => 1);
+
 -- Check 'invalidate' buffer processing function for pg_change_buffer()
 SELECT pg_change_buffer(
     'invalidate', 
@@ -137,6 +170,36 @@ SELECT pg_change_buffer(
 
 SELECT * FROM pg_show_buffer((TABLE test_buf_num));
 
+--
+-- Check temporary relations (local buffers)
+--
+CREATE TEMP TABLE test_temp(col integer);
+INSERT INTO test_temp 
+    SELECT 1 FROM generate_series(1,1000); 
+
+SELECT count(*) > 0 FROM pg_show_relation_buffers('test_temp') WHERE dirty;
+
+SELECT pg_change_relation_buffers('flush', 'test_temp');
+
+SELECT count(*) FROM pg_show_relation_buffers('test_temp') WHERE dirty;
+
+-- evicted pages are read back from the file
+SELECT pg_change_relation_fork_buffers('evict', 'test_temp', 'main');
+
+SELECT count(*) FROM pg_show_relation_buffers('test_temp') WHERE fork = 'main';
+
+SELECT sum(col) FROM test_temp;
+
+SELECT pg_change_relation_buffers('invalidate', 'test_temp');
+
+SELECT count(*) FROM pg_show_relation_buffers('test_temp');
+
+SELECT pg_change_relation_buffers('mark_dirty', 'test_temp');
+
+SELECT pg_change_buffer_by_page('flush', 'test_temp', 'main', 0);
+
+DROP TABLE test_temp;
+
 --
 -- Cleanup 
 --
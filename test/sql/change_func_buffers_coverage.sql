@@ -198,6 +198,15 @@ SELECT * FROM tt_2;
 SELECT * FROM tt_3;
 \c test_database_1 \\
 
+-- 
+-- Check 'flush_balanced' buffer change mode over several tablespaces
+--
+SELECT pg_change_all_valid_buffers('mark_dirty');
+SELECT pg_change_all_valid_buffers('flush_balanced');
+
+SELECT * FROM tt_1;
+SELECT * FROM tt_2;
+
 -- 
 -- Check pg_change_buffer_by_page() buffers coverage
 --
@@ -0,0 +1,37 @@
+--
+-- Preparing
+--
+CREATE EXTENSION buffercache_tools;
+
+SHOW data_checksums;
+
+CREATE TABLE test_table(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,1000); 
+
+--
+-- Check that pg_verify_cached_pages() reports no false problems with
+-- data checksums: it does not verify them, the pages must pass anyway
+--
+
+-- the checksums are computed in a copy, the cached pages keep the old ones
+CHECKPOINT;
+
+SELECT count(*) > 0 FROM pg_show_relation_buffers('test_table') WHERE NOT dirty;
+
+SELECT count(*) FROM pg_verify_cached_pages('test_table');
+
+-- hint bits dirty the pages again
+SELECT count(*) FROM test_table;
+
+CHECKPOINT;
+
+SELECT count(*) FROM pg_verify_cached_pages('test_table');
+
+SELECT count(*) FROM pg_verify_cached_pages();
+
+--
+-- Cleanup
+--
+DROP TABLE test_table;
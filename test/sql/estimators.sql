@@ -0,0 +1,56 @@
+--
+-- Preparing
+--
+CREATE EXTENSION buffercache_tools;
+
+CREATE TABLE test_table(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,10000); 
+
+--
+-- Check pg_buffer_mrc()
+--
+SELECT pg_buffer_mrc_reset();
+
+-- the first sample only seeds the tracked tags, 
+-- there are many more cached pages than tracked tags
+SELECT pg_buffer_mrc_sample();
+
+SELECT count(*) FROM test_table;
+
+SELECT pg_buffer_mrc_sample() > 0;
+
+SELECT count(*) > 0, bool_and(hit_ratio BETWEEN 0 AND 1), bool_and(references_sampled > 0) 
+    FROM pg_buffer_mrc() 
+    WHERE datid IS NULL;
+
+SELECT pg_buffer_mrc_reset();
+
+SELECT count(*) FROM pg_buffer_mrc();
+
+--
+-- Check pg_buffer_hot_blocks()
+--
+SELECT pg_buffer_hot_blocks_reset();
+
+SELECT count(*) FROM test_table;
+
+SELECT pg_buffer_hot_blocks_sample() > 0;
+
+-- the sketch keeps at most hot_blocks_max_tracked counters
+SELECT count(*) BETWEEN 1 AND 16, bool_and(hotness > 0), bool_and(max_error < hotness) 
+    FROM pg_buffer_hot_blocks();
+
+SELECT count(*) FROM pg_buffer_hot_blocks(3);
+
+SELECT * FROM pg_buffer_hot_blocks(0);
+
+SELECT pg_buffer_hot_blocks_reset();
+
+SELECT count(*) FROM pg_buffer_hot_blocks();
+
+--
+-- Cleanup
+--
+DROP TABLE test_table;
@@ -0,0 +1,75 @@
+--
+-- Preparing
+--
+CREATE DATABASE test_database;
+
+\c test_database \\
+CREATE EXTENSION buffercache_tools;
+
+CREATE TABLE test_table(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,1000); 
+
+CHECKPOINT;
+
+--
+-- Check pg_show_buffer_page()
+--
+SELECT line_pointers, free_space, all_visible, has_free_lines 
+    FROM pg_show_buffer_page(
+        (SELECT buffernum FROM pg_show_relation_buffers('test_table')
+            WHERE fork = 'main' AND blocknum = 0)
+    );
+
+--
+-- Check pg_relation_cached_pages_stats()
+--
+SELECT cached_pages, dirty_pages, new_pages, line_pointers, free_space, 
+       pages_lsn_older
+    FROM pg_relation_cached_pages_stats('test_table');
+
+SELECT pages_lsn_older 
+    FROM pg_relation_cached_pages_stats('test_table', 'main', 
+                                        pg_current_wal_insert_lsn());
+
+SELECT pages_lsn_older 
+    FROM pg_relation_cached_pages_stats('test_table', 'main', '0/0');
+
+--
+-- Check pg_verify_cached_pages()
+--
+SELECT count(*) FROM pg_verify_cached_pages('test_table');
+
+SELECT count(*) FROM pg_verify_cached_pages(dboid => 
+    (SELECT oid FROM pg_database WHERE datname = current_database()));
+
+SELECT count(*) FROM pg_verify_cached_pages(first_buffer => 1, last_buffer => 1);
+
+SELECT * FROM pg_verify_cached_pages('test_table', 1);
+
+--
+-- Check that the sweeps do not change the usage counts of the pages
+--
+SELECT pg_change_relation_buffers('mark_dirty', 'test_table');
+
+SELECT pg_change_relation_buffers('change_usagecount', 'test_table', 1::bigint);
+
+SELECT pg_change_relation_buffers('flush', 'test_table');
+
+SELECT count(*) FROM pg_verify_cached_pages('test_table');
+
+SELECT cached_pages FROM pg_relation_cached_pages_stats('test_table');
+
+SELECT dirty, usagecount, count(*) 
+    FROM pg_show_relation_buffers('test_table') 
+    WHERE fork = 'main' 
+    GROUP BY dirty, usagecount;
+
+--
+-- Cleanup
+--
+DROP TABLE test_table;
+
+\c template1 \\
+DROP DATABASE test_database;
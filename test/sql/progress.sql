@@ -0,0 +1,51 @@
+--
+-- Preparing
+--
+CREATE EXTENSION buffercache_tools;
+
+CREATE TABLE test_table(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,1000); 
+
+--
+-- Check pg_buffercache_tools_progress
+--
+SELECT attname, format_type(atttypid, atttypmod) 
+    FROM pg_attribute 
+    WHERE attrelid = 'pg_buffercache_tools_progress'::regclass AND attnum > 0 
+    ORDER BY attnum;
+
+-- a finished sweep is removed from the view
+SELECT pg_change_relation_buffers('flush', 'test_table');
+
+SELECT count(*) FROM pg_buffercache_tools_progress WHERE pid = pg_backend_pid();
+
+-- a cancelled sweep is removed from the view
+SELECT pg_cancel_backend(pg_backend_pid()), pg_change_all_valid_buffers('flush');
+
+SELECT count(*) FROM pg_buffercache_tools_progress WHERE pid = pg_backend_pid();
+
+-- a sweep cancelled in a subtransaction is removed from the view too
+DO $$
+BEGIN
+    PERFORM pg_cancel_backend(pg_backend_pid()), pg_change_all_valid_buffers('flush');
+EXCEPTION WHEN query_canceled THEN
+    RAISE NOTICE 'sweep cancelled';
+END $$;
+
+SELECT count(*) FROM pg_buffercache_tools_progress WHERE pid = pg_backend_pid();
+
+--
+-- Check pg_buffercache_tools_stats
+--
+SELECT pg_buffercache_tools_stats_reset();
+
+SELECT pg_change_relation_buffers('flush', 'test_table');
+
+SELECT scope, mode, calls FROM pg_buffercache_tools_stats WHERE scope = 'relation';
+
+--
+-- Cleanup
+--
+DROP TABLE test_table;
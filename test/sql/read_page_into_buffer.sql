@@ -18,8 +18,104 @@ SELECT (
         WHERE blocknum = 0 AND fork = 'main')
 );
 
+-- 
+-- Check pg_read_blocks_into_buffer()
+--
+CHECKPOINT;
+SELECT pg_change_relation_fork_buffers('invalidate', 'test_table', 'main');
+
+SELECT pg_read_blocks_into_buffer('test_table', 'main', ARRAY[3, 1, 3, 0]);
+
+SELECT blocknum FROM pg_show_relation_buffers('test_table') 
+    WHERE fork = 'main' 
+    ORDER BY blocknum;
+
+-- already cached blocks are not read again
+SELECT pg_read_blocks_into_buffer('test_table', 'main', ARRAY[0, 1, 2]);
+
+SELECT pg_read_blocks_into_buffer('test_table', 'main', ARRAY[5]);
+
+--
+-- Check pg_prewarm_index_upper_levels()
+--
+CREATE TABLE test_index_table(id integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_index_table 
+    SELECT i FROM generate_series(1,100000) AS i; 
+CREATE INDEX test_index ON test_index_table(id);
+
+CHECKPOINT;
+SELECT pg_change_relation_buffers('invalidate', 'test_index') IS NOT NULL;
+
+-- the metapage and the root, the leaves are not read
+SELECT pg_prewarm_index_upper_levels('test_index', 1);
+
+SELECT pg_prewarm_index_upper_levels('test_index');
+
+SELECT count(*) FROM pg_show_relation_buffers('test_index');
+
+SELECT pg_prewarm_index_upper_levels('test_index', 0);
+
+SELECT pg_prewarm_index_upper_levels('test_index_table');
+
+DROP TABLE test_index_table;
+
+--
+-- Check pg_extend_relation_buffers()
+--
+SELECT pg_extend_relation_buffers('test_table', 'main', 3);
+
+SELECT pg_relation_size('test_table') / current_setting('block_size')::integer;
+
+SELECT count(*) FROM pg_show_relation_buffers('test_table') 
+    WHERE fork = 'main' AND blocknum >= 5;
+
+-- inserts find the new pages in the free space map
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,300); 
+
+SELECT pg_relation_size('test_table') / current_setting('block_size')::integer;
+
+SELECT pg_extend_relation_buffers('test_table', 'main', 0);
+
+SELECT pg_extend_relation_buffers('test_table', 'vm', 1);
+
+--
+-- Check pg_remap_relation_buffers()
+--
+CREATE TABLE test_copy(col integer) 
+    WITH (autovacuum_enabled = off);
+
+CHECKPOINT;
+
+SELECT count(*) AS cached FROM pg_show_relation_buffers('test_table') \gset
+SELECT pg_relation_filenode('test_table') AS old_filenode \gset
+
+-- the empty relation has none of the blocks
+SELECT remapped, collisions, pinned, past_end = :cached 
+    FROM pg_remap_relation_buffers('test_copy', :old_filenode);
+
+-- the file is copied to the new tablespace, the old one is dropped at commit
+SET allow_in_place_tablespaces = true;
+CREATE TABLESPACE regress_bct_tblspace LOCATION '';
+
+BEGIN;
+ALTER TABLE test_table SET TABLESPACE regress_bct_tblspace;
+
+SELECT remapped = :cached, collisions, pinned, past_end 
+    FROM pg_remap_relation_buffers('test_table', :old_filenode, 
+        (SELECT oid FROM pg_tablespace WHERE spcname = 'pg_default'));
+COMMIT;
+
+SELECT count(*) = :cached FROM pg_show_relation_buffers('test_table');
+
+SELECT sum(col) FROM test_table;
+
+SELECT * FROM pg_remap_relation_buffers('test_copy', pg_relation_filenode('test_copy'));
+
 --
 -- Cleanup
 --
+DROP TABLE test_copy;
 DROP TABLE test_table;
-
+DROP TABLESPACE regress_bct_tblspace;
@@ -0,0 +1,121 @@
+--
+-- Preparing
+--
+CREATE DATABASE test_database;
+
+\c test_database \\
+CREATE EXTENSION buffercache_tools;
+
+CREATE TABLE test_table(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,1000); 
+
+CREATE TABLE test_snapshots(name text, snap bytea);
+
+CREATE VIEW test_rel AS
+    SELECT pg_relation_filenode('test_table') AS relnumber;
+
+CHECKPOINT;
+
+--
+-- Check pg_buffer_residency_snapshot() and pg_buffer_residency_diff()
+--
+INSERT INTO test_snapshots SELECT 'before', pg_buffer_residency_snapshot();
+
+-- a snapshot does not differ from itself
+SELECT pages_added, pages_evicted, pages_retained, usagecount_drift
+    FROM pg_buffer_residency_diff(
+        (SELECT snap FROM test_snapshots WHERE name = 'before'),
+        (SELECT snap FROM test_snapshots WHERE name = 'before'))
+    WHERE relfilenode = (SELECT relnumber FROM test_rel);
+
+-- evicted pages
+SELECT pg_change_relation_fork_buffers('invalidate', 'test_table', 'main');
+
+INSERT INTO test_snapshots SELECT 'evicted', pg_buffer_residency_snapshot();
+
+SELECT pages_added, pages_evicted, pages_retained
+    FROM pg_buffer_residency_diff(
+        (SELECT snap FROM test_snapshots WHERE name = 'before'),
+        (SELECT snap FROM test_snapshots WHERE name = 'evicted'))
+    WHERE relfilenode = (SELECT relnumber FROM test_rel);
+
+-- added pages
+SELECT pg_read_blocks_into_buffer('test_table', 'main', ARRAY[0, 1, 2]);
+
+INSERT INTO test_snapshots SELECT 'added', pg_buffer_residency_snapshot();
+
+SELECT pages_added, pages_evicted, pages_retained
+    FROM pg_buffer_residency_diff(
+        (SELECT snap FROM test_snapshots WHERE name = 'evicted'),
+        (SELECT snap FROM test_snapshots WHERE name = 'added'))
+    WHERE relfilenode = (SELECT relnumber FROM test_rel);
+
+-- invalid snapshot
+SELECT * FROM pg_buffer_residency_diff('\x00', '\x00');
+
+--
+-- Check pg_relation_residency_bitmap() and its helpers
+--
+INSERT INTO test_snapshots SELECT 'bitmap_before', pg_relation_residency_bitmap('test_table');
+
+SELECT pg_residency_bitmap_count(snap) FROM test_snapshots WHERE name = 'bitmap_before';
+
+SELECT pg_read_blocks_into_buffer('test_table', 'main', ARRAY[3, 4]);
+
+INSERT INTO test_snapshots SELECT 'bitmap_after', pg_relation_residency_bitmap('test_table', 'main', true);
+
+SELECT pg_residency_bitmap_count(snap) FROM test_snapshots WHERE name = 'bitmap_after';
+
+SELECT pg_residency_bitmap_count(pg_residency_bitmap_and(
+        (SELECT snap FROM test_snapshots WHERE name = 'bitmap_after'),
+        (SELECT snap FROM test_snapshots WHERE name = 'bitmap_before')));
+
+SELECT pg_residency_bitmap_count(pg_residency_bitmap_diff(
+        (SELECT snap FROM test_snapshots WHERE name = 'bitmap_after'),
+        (SELECT snap FROM test_snapshots WHERE name = 'bitmap_before')));
+
+-- the fork does not exist
+SELECT pg_residency_bitmap_count(pg_relation_residency_bitmap('test_table', 'vm'));
+
+-- run-length encoding of a fully cached relation
+CREATE TABLE test_big(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_big 
+    SELECT 1 FROM generate_series(1,100000); 
+
+SELECT pg_residency_bitmap_count(pg_relation_residency_bitmap('test_big', 'main', true)) = 
+    pg_relation_size('test_big') / current_setting('block_size')::integer;
+
+SELECT octet_length(pg_relation_residency_bitmap('test_big', 'main', true)) < 
+    octet_length(pg_relation_residency_bitmap('test_big'));
+
+-- invalid bitmap
+SELECT pg_residency_bitmap_count('\x00');
+
+--
+-- Check pg_buffer_mapping_partitions()
+--
+SELECT count(*), sum(buffers) >= sum(top_relations_buffers), 
+       bool_and(wait_samples IS NULL)
+    FROM pg_buffer_mapping_partitions();
+
+SELECT sum(top_relations_buffers) 
+    FROM pg_buffer_mapping_partitions(0);
+
+SELECT count(*) FROM pg_buffer_mapping_partitions(1, 5) 
+    WHERE wait_ratio BETWEEN 0 AND 1;
+
+SELECT * FROM pg_buffer_mapping_partitions(-1);
+
+--
+-- Cleanup
+--
+DROP VIEW test_rel;
+DROP TABLE test_big;
+DROP TABLE test_snapshots;
+DROP TABLE test_table;
+
+\c template1 \\
+DROP DATABASE test_database;
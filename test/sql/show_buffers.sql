@@ -0,0 +1,75 @@
+--
+-- Preparing
+--
+CREATE DATABASE test_database;
+
+\c test_database \\
+CREATE EXTENSION buffercache_tools;
+
+CREATE TABLE test_table(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_table 
+    SELECT 1 FROM generate_series(1,1000); 
+
+CREATE VIEW test_rel AS
+    SELECT pg_relation_filenode('test_table') AS relnumber,
+           (SELECT oid FROM pg_database 
+                WHERE datname = current_database()) AS dboid;
+
+CHECKPOINT;
+
+--
+-- Check pg_show_buffers()
+--
+
+-- the same buffers as pg_show_relation_buffers() 
+SELECT (
+    (SELECT count(*) FROM pg_show_buffers(
+        filter_dboid => (SELECT dboid FROM test_rel),
+        filter_relnumber => (SELECT relnumber FROM test_rel))) =
+    (SELECT count(*) FROM pg_show_relation_buffers('test_table'))
+);
+
+-- fork filter
+SELECT DISTINCT fork FROM pg_show_buffers(
+    filter_relnumber => (SELECT relnumber FROM test_rel),
+    filter_fork => 'main');
+
+-- dirty filter
+SELECT count(*) FROM pg_show_buffers(
+    filter_relnumber => (SELECT relnumber FROM test_rel),
+    filter_dirty => true);
+
+SELECT pg_change_relation_fork_buffers('mark_dirty', 'test_table', 'main');
+
+SELECT blocknum FROM pg_show_buffers(
+    filter_relnumber => (SELECT relnumber FROM test_rel),
+    filter_dirty => true)
+    ORDER BY blocknum;
+
+-- called in the select list the scan stops at the LIMIT
+SELECT count(*) FROM (SELECT pg_show_buffers() AS b LIMIT 3) AS s;
+
+--
+-- Check pg_buffer_strategy()
+--
+
+-- every buffer is counted once
+SELECT next_victim_buffer > 0, sweep_rate IS NULL, 
+       array_length(usagecount_hist, 1),
+       (SELECT sum(u) FROM unnest(usagecount_hist) AS u) + unused_buffers = 
+           (SELECT setting::bigint FROM pg_settings WHERE name = 'shared_buffers')
+    FROM pg_buffer_strategy();
+
+-- the rates are computed from the second call on
+SELECT sweep_rate >= 0, alloc_rate IS NOT NULL 
+    FROM pg_buffer_strategy();
+
+--
+-- Cleanup
+--
+DROP VIEW test_rel;
+DROP TABLE test_table;
+
+\c template1 \\
+DROP DATABASE test_database;
@@ -0,0 +1,133 @@
+--
+-- Preparing
+--
+CREATE EXTENSION buffercache_tools;
+
+CREATE TABLE test_interval(col integer) 
+    WITH (autovacuum_enabled = off);
+CREATE TABLE test_watermark(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_interval 
+    SELECT 1 FROM generate_series(1,1000); 
+INSERT INTO test_watermark 
+    SELECT 1 FROM generate_series(1,1000); 
+
+--
+-- Check the background flush worker
+--
+
+-- the interval of a new entry has expired, 
+-- the other entry is flushed only by its dirty watermark
+INSERT INTO buffercache_tools_flush_schedule (relid, flush_interval) 
+    VALUES ('test_interval', '1 hour');
+INSERT INTO buffercache_tools_flush_schedule (relid, flush_interval, max_dirty_fraction, last_run) 
+    VALUES ('test_watermark', '1 hour', 0.5, now());
+
+-- the worker may be restarting until the test database exists
+DO $$
+BEGIN
+    FOR i IN 1..600 LOOP
+        EXIT WHEN (SELECT count(*) FROM buffercache_tools_flush_history) >= 2;
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END $$;
+
+SELECT s.relid, h.reason, h.dirty_fraction > 0.5 AS above_watermark, 
+       h.buffers_written > 0 AS written,
+       h.buffers_written * current_setting('block_size')::bigint = h.bytes_written AS bytes
+    FROM buffercache_tools_flush_history h 
+    JOIN buffercache_tools_flush_schedule s ON s.id = h.schedule_id 
+    ORDER BY s.id;
+
+SELECT count(*) FROM pg_show_relation_buffers('test_interval') WHERE dirty;
+
+--
+-- Check the jobs
+--
+CREATE TABLE test_jobs(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_jobs 
+    SELECT 1 FROM generate_series(1,1000); 
+
+SELECT pg_buffercache_tools_submit('flush', 'relation', 'test_jobs'::regclass) AS job_id \gset
+
+DO $$
+BEGIN
+    FOR i IN 1..600 LOOP
+        EXIT WHEN NOT EXISTS (SELECT 1 FROM pg_buffercache_tools_jobs 
+                              WHERE status IN ('queued', 'running'));
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END $$;
+
+SELECT mode, scope, target::regclass, status, error, bytes_written > 0 AS written 
+    FROM pg_buffercache_tools_jobs WHERE job_id = :job_id;
+
+SELECT count(*) FROM pg_show_relation_buffers('test_jobs') WHERE dirty;
+
+-- a finished job can't be cancelled
+SELECT pg_buffercache_tools_cancel(:job_id);
+
+SELECT pg_buffercache_tools_cancel(-1);
+
+SELECT pg_buffercache_tools_submit('flush', 'page');
+
+SELECT pg_buffercache_tools_submit('flush', 'relation_fork', 'test_jobs'::regclass);
+
+--
+-- Check the keep-warm list
+--
+CREATE TABLE test_warm(col integer) 
+    WITH (autovacuum_enabled = off);
+CREATE TABLE test_capped(col integer) 
+    WITH (autovacuum_enabled = off);
+INSERT INTO test_warm 
+    SELECT 1 FROM generate_series(1,10000); 
+INSERT INTO test_capped 
+    SELECT 1 FROM generate_series(1,100000); 
+
+-- the pages are written before they are dropped from the cache
+CHECKPOINT;
+
+SELECT pg_change_relation_buffers('invalidate', 'test_warm');
+SELECT pg_change_relation_buffers('invalidate', 'test_capped');
+
+SELECT count(*) FROM pg_show_relation_buffers('test_warm') WHERE fork = 'main';
+
+-- one block of test_capped per 100ms round
+INSERT INTO buffercache_tools_keep_warm (relid, min_usagecount) 
+    VALUES ('test_warm', 5);
+INSERT INTO buffercache_tools_keep_warm (relid, max_read_rate) 
+    VALUES ('test_capped', 10);
+
+DO $$
+BEGIN
+    FOR i IN 1..600 LOOP
+        EXIT WHEN (SELECT bool_and(blocks_restored > 0) FROM buffercache_tools_keep_warm);
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END $$;
+
+SELECT relid, last_check IS NOT NULL AS checked, 
+       blocks_restored = pg_relation_size(relid) / current_setting('block_size')::bigint AS all_restored
+    FROM buffercache_tools_keep_warm 
+    ORDER BY id;
+
+SELECT count(*) = pg_relation_size('test_warm') / current_setting('block_size')::bigint AS all_cached, 
+       min(usagecount) 
+    FROM pg_show_relation_buffers('test_warm') WHERE fork = 'main';
+
+SELECT count(*) < pg_relation_size('test_capped') / current_setting('block_size')::bigint AS capped 
+    FROM pg_show_relation_buffers('test_capped') WHERE fork = 'main';
+
+DELETE FROM buffercache_tools_keep_warm;
+
+--
+-- Cleanup
+--
+DELETE FROM buffercache_tools_flush_schedule;
+DROP TABLE test_interval;
+DROP TABLE test_watermark;
+DROP TABLE test_jobs;
+DROP TABLE test_warm;
+DROP TABLE test_capped;
@@ -0,0 +1,200 @@
+#!/bin/sh
+#
+# stress.sh
+#
+#		Impact of the buffer change functions on a concurrent OLTP load
+#
+# Runs a pgbench baseline and then the same load once per operation while
+# the operation is repeated in a loop from another session. For every run
+# foreground TPS, p99 latency, the longest heavyweight lock wait and the
+# number of backends seen waiting for a buffer content lock are recorded.
+# The run fails if an operation makes TPS or p99 latency worse than the
+# baseline by more than the allowed percentage, or if lock waits exceed
+# the limit.
+#
+# Connection is configured by the usual libpq environment variables
+# (PGHOST, PGPORT, PGDATABASE, PGUSER). The database is initialized with
+# pgbench -i, so do not point it at a database that matters.
+#
+# Modes that change buffer tags are never run: under load they corrupt the
+# relation. Invalidation runs only after a flush with the table locked, so
+# that no dirty page is dropped.
+#
+
+set -e
+
+DURATION=${DURATION:-20}				# seconds per run
+CLIENTS=${CLIENTS:-8}
+SCALE=${SCALE:-10}
+OPS=${OPS:-.}							# regex of operations to run
+MAX_TPS_DROP_PCT=${MAX_TPS_DROP_PCT:-20}
+MAX_P99_INCREASE_PCT=${MAX_P99_INCREASE_PCT:-50}
+MAX_LOCK_WAIT_MS=${MAX_LOCK_WAIT_MS:-200}
+MAX_EXCLUSIVE_LOCK_WAIT_MS=${MAX_EXCLUSIVE_LOCK_WAIT_MS:-5000}
+
+WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/bct_stress.XXXXXX")
+RESULTS=$WORKDIR/results
+FAILED=0
+
+PSQL="psql -X -q -t -A -v ON_ERROR_STOP=1"
+
+trap 'kill $(jobs -p) 2>/dev/null || true' EXIT
+
+#
+# Operations: name|exclusive|SQL
+#
+# An exclusive operation takes AccessExclusiveLock on the relation, so
+# foreground queries wait for it and it is checked against
+# MAX_EXCLUSIVE_LOCK_WAIT_MS instead of MAX_LOCK_WAIT_MS.
+#
+operations()
+{
+	for mode in mark_dirty flush flush_balanced change_usagecount flush_older_than
+	do
+		case $mode in
+			change_usagecount)	arg=", 5::bigint" ;;
+			flush_older_than)	arg=", (pg_current_wal_lsn() - '0/0')::bigint" ;;
+			*)					arg="" ;;
+		esac
+
+		echo "buffer_$mode|f|SELECT pg_change_buffer('$mode', buffernum$arg) FROM pg_show_relation_buffers('pgbench_accounts') LIMIT 1"
+		echo "relation_fork_$mode|f|SELECT pg_change_relation_fork_buffers('$mode', 'pgbench_accounts', 'main'$arg)"
+		echo "relation_$mode|f|SELECT pg_change_relation_buffers('$mode', 'pgbench_accounts'$arg)"
+		echo "database_$mode|f|SELECT pg_change_database_buffers('$mode', oid$arg) FROM pg_database WHERE datname = current_database()"
+		echo "tablespace_$mode|f|SELECT pg_change_tablespace_buffers('$mode', oid$arg) FROM pg_tablespace WHERE spcname = 'pg_default'"
+		echo "all_valid_$mode|f|SELECT pg_change_all_valid_buffers('$mode'$arg)"
+	done
+
+	echo "relation_invalidate|t|BEGIN; LOCK TABLE pgbench_accounts; SELECT pg_change_relation_buffers('flush', 'pgbench_accounts'); SELECT pg_change_relation_buffers('invalidate', 'pgbench_accounts'); COMMIT"
+	echo "show_relation_buffers|f|SELECT count(*) FROM pg_show_relation_buffers('pgbench_accounts')"
+	echo "show_buffers|f|SELECT count(*) FROM pg_show_buffers()"
+	echo "prewarm|f|SELECT pg_read_blocks_into_buffer('pgbench_accounts', 'main', ARRAY(SELECT generate_series(0, pg_relation_size('pgbench_accounts') / current_setting('block_size')::bigint - 1)))"
+}
+
+#
+# Poll lock waits while pgbench is running.
+# Writes "max_lock_wait_ms buffer_content_waits" to $1.
+#
+poll_waits()
+{
+	out=$1
+	pid=$2
+	max_wait=0
+	content_waits=0
+
+	while kill -0 "$pid" 2>/dev/null
+	do
+		sample=$($PSQL -F ' ' -c "
+			SELECT coalesce(round(max(extract(epoch FROM now() - waitstart)) * 1000), 0),
+				   (SELECT count(*) FROM pg_stat_activity WHERE wait_event = 'BufferContent')
+			FROM pg_locks WHERE NOT granted" 2>/dev/null) || break
+
+		set -- $sample
+		[ "$1" -gt "$max_wait" ] && max_wait=$1
+		content_waits=$((content_waits + $2))
+		# POSIX sleep takes whole seconds only
+		$PSQL -c "SELECT pg_sleep(0.1)" >/dev/null 2>&1 || break
+	done
+
+	echo "$max_wait $content_waits" > "$out"
+}
+
+#
+# Run the load, optionally with an operation looping next to it.
+# Appends "name tps p99_ms max_lock_wait_ms buffer_content_waits" to RESULTS.
+#
+run()
+{
+	name=$1
+	sql=$2
+
+	pgbench -n -c "$CLIENTS" -j "$CLIENTS" -T "$DURATION" -l \
+		--log-prefix="$WORKDIR/$name" > "$WORKDIR/$name.out" 2>&1 &
+	bench=$!
+
+	poll_waits "$WORKDIR/$name.waits" $bench &
+	poller=$!
+
+	if [ -n "$sql" ]
+	then
+		while kill -0 $bench 2>/dev/null
+		do
+			$PSQL -c "$sql" > /dev/null
+		done &
+	fi
+
+	wait $bench
+	wait $poller
+
+	tps=$(sed -n 's/^tps = \([0-9.]*\).*/\1/p' "$WORKDIR/$name.out" | tail -n 1)
+
+	# the third field of a transaction log line is the latency in microseconds
+	p99=$(cat "$WORKDIR/$name".[0-9]* | awk '{ print $3 }' | sort -n | \
+		  awk '{ v[NR] = $1 } END { i = int(NR * 0.99); if (i < 1) i = 1; printf "%.3f", v[i] / 1000 }')
+
+	echo "$name $tps $p99 $(cat "$WORKDIR/$name.waits")" >> "$RESULTS"
+	rm -f "$WORKDIR/$name".[0-9]*
+}
+
+check()
+{
+	name=$1
+	exclusive=$2
+
+	set -- $(grep "^baseline " "$RESULTS")
+	base_tps=$2
+	base_p99=$3
+
+	set -- $(grep "^$name " "$RESULTS")
+	tps=$2
+	p99=$3
+	lock_wait=$4
+
+	if [ "$exclusive" = t ]
+	then
+		max_wait=$MAX_EXCLUSIVE_LOCK_WAIT_MS
+	else
+		max_wait=$MAX_LOCK_WAIT_MS
+	fi
+
+	verdict=$(awk -v tps="$tps" -v p99="$p99" -v wait="$lock_wait" \
+				  -v btps="$base_tps" -v bp99="$base_p99" -v maxwait="$max_wait" \
+				  -v tpsdrop="$MAX_TPS_DROP_PCT" -v p99inc="$MAX_P99_INCREASE_PCT" '
+		BEGIN {
+			if (tps < btps * (1 - tpsdrop / 100))
+				print "tps";
+			else if (p99 > bp99 * (1 + p99inc / 100))
+				print "p99";
+			else if (wait > maxwait)
+				print "lock_wait";
+		}')
+
+	if [ -n "$verdict" ]
+	then
+		echo "FAILED: $name ($verdict)"
+		FAILED=1
+	fi
+}
+
+pgbench -i -q -s "$SCALE" > /dev/null 2>&1
+$PSQL -c "CREATE EXTENSION IF NOT EXISTS buffercache_tools"
+
+run baseline ""
+
+operations | grep -E "^[^|]*($OPS)" > "$WORKDIR/operations" || true
+
+while IFS='|' read -r name exclusive sql
+do
+	run "$name" "$sql"
+	check "$name" "$exclusive"
+done < "$WORKDIR/operations"
+
+printf "%-36s %10s %10s %14s %14s\n" operation tps p99_ms lock_wait_ms content_waits
+while read -r name tps p99 lock_wait content_waits
+do
+	printf "%-36s %10s %10s %14s %14s\n" "$name" "$tps" "$p99" "$lock_wait" "$content_waits"
+done < "$RESULTS"
+
+echo "results: $RESULTS"
+
+exit $FAILED